@@ -201,6 +201,16 @@ template void base_uint<256>::SetHex(const char*);
 template void base_uint<256>::SetHex(const std::string&);
 template unsigned int base_uint<256>::bits() const;
 
+// Explicit instantiations for base_uint<512>
+template base_uint<512>& base_uint<512>::operator<<=(unsigned int);
+template base_uint<512>& base_uint<512>::operator>>=(unsigned int);
+template base_uint<512>& base_uint<512>::operator*=(uint32_t b32);
+template base_uint<512>& base_uint<512>::operator*=(const base_uint<512>& b);
+template base_uint<512>& base_uint<512>::operator/=(const base_uint<512>& b);
+template int base_uint<512>::CompareTo(const base_uint<512>&) const;
+template bool base_uint<512>::EqualTo(uint64_t) const;
+template unsigned int base_uint<512>::bits() const;
+
 // This implementation directly uses shifts instead of going
 // through an intermediate MPI representation.
 arith_uint256& arith_uint256::SetCompact(uint32_t nCompact, bool* pfNegative, bool* pfOverflow)
@@ -260,3 +270,22 @@ arith_uint256 UintToArith256(const uint256 &a)
         b.pn[x] = ReadLE32(a.begin() + x*4);
     return b;
 }
+
+arith_uint512::arith_uint512(const arith_uint256& b)
+{
+    for (int x = 0; x < 256 / 64; ++x) {
+        uint64_t n = (b >> (64 * x)).GetLow64();
+        pn[2 * x] = (uint32_t)n;
+        pn[2 * x + 1] = (uint32_t)(n >> 32);
+    }
+}
+
+arith_uint256 arith_uint512::trim256() const
+{
+    arith_uint256 b;
+    for (int x = WIDTH / 2 - 1; x >= 0; --x) {
+        b <<= 32;
+        b |= pn[x];
+    }
+    return b;
+}
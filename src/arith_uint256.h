@@ -286,4 +286,16 @@ public:
 uint256 ArithToUint256(const arith_uint256 &);
 arith_uint256 UintToArith256(const uint256 &);
 
+/** 512-bit unsigned big integer, for products of arith_uint256 values that must not overflow. */
+class arith_uint512 : public base_uint<512> {
+public:
+    arith_uint512() {}
+    arith_uint512(const base_uint<512>& b) : base_uint<512>(b) {}
+    arith_uint512(uint64_t b) : base_uint<512>(b) {}
+    explicit arith_uint512(const arith_uint256& b);
+
+    /** The low 256 bits */
+    arith_uint256 trim256() const;
+};
+
 #endif // BITCOIN_ARITH_UINT256_H
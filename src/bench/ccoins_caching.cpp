@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <wallet/crypter.h>
 
 #include <vector>
@@ -85,4 +86,35 @@ static void CCoinsCaching(benchmark::State& state)
     }
 }
 
+// Pull coins into a cache from its parent, look them up again and evict them,
+// as ConnectBlock and the mempool do with pcoinsTip.
+static void CCoinsCacheFill(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    const CScript script = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CCoinsView coinsDummy;
+    CCoinsViewCache base(&coinsDummy);
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 10000; i++) {
+        outpoints.emplace_back(rng.rand256(), rng.randrange(4));
+        base.AddCoin(outpoints.back(), Coin(CTxOut(COIN, script), 1, false), false);
+    }
+
+    CCoinsViewCache coins(&base);
+    while (state.KeepRunning()) {
+        CAmount value = 0;
+        for (const COutPoint& outpoint : outpoints) {
+            value += coins.AccessCoin(outpoint).out.nValue;
+        }
+        for (const COutPoint& outpoint : outpoints) {
+            value += coins.AccessCoin(outpoint).out.nValue;
+        }
+        assert(value == 2 * (CAmount)outpoints.size() * COIN);
+        for (const COutPoint& outpoint : outpoints) {
+            coins.Uncache(outpoint);
+        }
+    }
+}
+
 BENCHMARK(CCoinsCaching, 170 * 1000);
+BENCHMARK(CCoinsCacheFill, 20);
@@ -0,0 +1,105 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <crypto/neoscrypt.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <uint256.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+static const size_t HEADERS_PER_RUN = 64;
+
+static CBlockHeader RandomHeader(FastRandomContext& rng)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = rng.rand256();
+    header.hashMerkleRoot = rng.rand256();
+    header.nTime = 1500000000 + rng.randrange(1000000);
+    header.nBits = 0x1c0fffff;
+    header.nNonce = rng.rand32();
+    return header;
+}
+
+static std::vector<CBlockHeader> RandomHeaders(size_t count)
+{
+    FastRandomContext rng(true);
+    std::vector<CBlockHeader> headers;
+    headers.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        headers.push_back(RandomHeader(rng));
+    return headers;
+}
+
+// Single hash latency of the reference implementation, for the current
+// (0x0) and the pre-fork (0x3) profile
+static void NeoScrypt(benchmark::State& state, unsigned int profile)
+{
+    unsigned char input[80] = {0};
+    uint256 output;
+    while (state.KeepRunning()) {
+        neoscrypt(input, output.begin(), profile);
+        input[0] = output.begin()[0];
+    }
+}
+
+static void NeoScryptProfile0(benchmark::State& state)
+{
+    NeoScrypt(state, 0x0);
+}
+
+static void NeoScryptProfile3(benchmark::State& state)
+{
+    NeoScrypt(state, 0x3);
+}
+
+static void NeoScryptGetPoWHash(benchmark::State& state)
+{
+    CBlockHeader header = RandomHeaders(1)[0];
+    while (state.KeepRunning()) {
+        uint256 hash = header.GetPoWHash(0x0);
+        header.nNonce = hash.GetUint64(0);
+    }
+}
+
+// Throughput of the multi-lane engine picked by NeoScryptAutoDetect()
+static void NeoScryptMulti(benchmark::State& state)
+{
+    const std::vector<CBlockHeader> headers = RandomHeaders(HEADERS_PER_RUN);
+    std::vector<uint256> hashes(HEADERS_PER_RUN);
+    while (state.KeepRunning()) {
+        CBlockHeader::GetPoWHashes(headers.data(), headers.size(), 0x0, hashes.data());
+    }
+}
+
+// Throughput with the headers split between one thread per core
+static void NeoScryptThreads(benchmark::State& state)
+{
+    const std::vector<CBlockHeader> headers = RandomHeaders(HEADERS_PER_RUN);
+    std::vector<uint256> hashes(HEADERS_PER_RUN);
+    const size_t nThreads = std::max(GetNumCores(), 1);
+    const size_t nPerThread = (HEADERS_PER_RUN + nThreads - 1) / nThreads;
+    while (state.KeepRunning()) {
+        std::vector<std::thread> threads;
+        for (size_t begin = 0; begin < HEADERS_PER_RUN; begin += nPerThread) {
+            const size_t count = std::min(nPerThread, HEADERS_PER_RUN - begin);
+            threads.emplace_back([&headers, &hashes, begin, count] {
+                CBlockHeader::GetPoWHashes(headers.data() + begin, count, 0x0, hashes.data() + begin);
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+}
+
+BENCHMARK(NeoScryptProfile0, 2000);
+BENCHMARK(NeoScryptProfile3, 2000);
+BENCHMARK(NeoScryptGetPoWHash, 2000);
+BENCHMARK(NeoScryptMulti, 30);
+BENCHMARK(NeoScryptThreads, 30);
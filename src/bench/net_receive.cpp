@@ -0,0 +1,47 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chainparams.h>
+#include <net.h>
+#include <primitives/block.h>
+#include <protocol.h>
+#include <streams.h>
+
+namespace block_bench {
+#include <bench/data/block413567.raw.h>
+} // namespace block_bench
+
+// The receive path of a block message: socket reads handed over in 64 KiB
+// chunks, hashed and gathered into the message buffer, then deserialized.
+
+static void NetMessageReceiveBlock(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    CMessageHeader hdr(chainParams->MessageStart(), NetMsgType::BLOCK, sizeof(block_bench::block413567));
+    CDataStream wire(SER_NETWORK, PROTOCOL_VERSION);
+    wire << hdr;
+    wire.write((const char*)block_bench::block413567, sizeof(block_bench::block413567));
+
+    while (state.KeepRunning()) {
+        CNetMessage msg(chainParams->MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+        const char* pch = wire.data();
+        size_t nRemaining = wire.size();
+        while (nRemaining > 0) {
+            unsigned int nBytes = std::min<size_t>(nRemaining, 0x10000);
+            int handled = msg.in_data ? msg.readData(pch, nBytes) : msg.readHeader(pch, nBytes);
+            assert(handled > 0);
+            pch += handled;
+            nRemaining -= handled;
+        }
+        assert(msg.complete());
+        msg.GetMessageHash();
+
+        CBlock block;
+        msg.vRecv >> block;
+    }
+}
+
+BENCHMARK(NetMessageReceiveBlock, 100);
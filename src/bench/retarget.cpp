@@ -0,0 +1,67 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <pow.h>
+#include <random.h>
+
+#include <vector>
+
+// Enough history for the long sample of V3
+static const int RETARGET_CHAIN_LENGTH = 2000;
+
+static std::vector<CBlockIndex> SyntheticChain(const Consensus::Params& params)
+{
+    FastRandomContext rng(true);
+    std::vector<CBlockIndex> blocks(RETARGET_CHAIN_LENGTH);
+    for (int i = 0; i < RETARGET_CHAIN_LENGTH; i++) {
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        blocks[i].nTime = 1500000000 + i * params.nPowTargetSpacing + rng.randrange(2 * params.nPowTargetSpacing);
+        blocks[i].nBits = 0x1c0fffff - rng.randrange(0x8000);
+        blocks[i].BuildSkip();
+    }
+    return blocks;
+}
+
+static void RetargetV1(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    std::vector<CBlockIndex> blocks = SyntheticChain(params);
+    // V1 only does work at the last block of an adjustment interval
+    const int64_t nInterval = params.DifficultyAdjustmentInterval();
+    const CBlockIndex* pindexLast = &blocks[RETARGET_CHAIN_LENGTH / nInterval * nInterval - 1];
+    CBlockHeader header;
+    header.nTime = pindexLast->nTime + params.nPowTargetSpacing;
+    while (state.KeepRunning()) {
+        GetNextWorkRequired_V1(pindexLast, &header, params);
+    }
+}
+
+static void RetargetV2(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    std::vector<CBlockIndex> blocks = SyntheticChain(params);
+    while (state.KeepRunning()) {
+        GetNextWorkRequired_V2(&blocks.back(), params);
+    }
+}
+
+static void RetargetV3(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    std::vector<CBlockIndex> blocks = SyntheticChain(params);
+    while (state.KeepRunning()) {
+        GetNextWorkRequired_V3(&blocks.back(), params);
+    }
+}
+
+BENCHMARK(RetargetV1, 500000);
+BENCHMARK(RetargetV2, 20000);
+BENCHMARK(RetargetV3, 500000);
@@ -157,6 +157,9 @@ public:
             /* dTxRate  */ 0.001
         };
 
+        // No trusted UTXO set snapshot yet
+        m_assumeutxo_data = {};
+
         /* disable fallback fee on mainnet */
         m_fallback_fee_enabled = true;
     }
@@ -257,6 +260,8 @@ public:
             /* dTxRate  */ 0.001
         };
 
+        m_assumeutxo_data = {};
+
         /* enable fallback fee on testnet */
         m_fallback_fee_enabled = true;
     }
@@ -340,6 +345,8 @@ public:
             0
         };
 
+        UpdateAssumeutxoFromArgs(args);
+
         base58Prefixes[PUBKEY_ADDRESS] = std::vector<unsigned char>(1,111);
         base58Prefixes[SCRIPT_ADDRESS] = std::vector<unsigned char>(1,196);
         base58Prefixes[SCRIPT_ADDRESS2] = std::vector<unsigned char>(1,130);
@@ -362,6 +369,7 @@ public:
         consensus.vDeployments[d].nTimeout = nTimeout;
     }
     void UpdateVersionBitsParametersFromArgs(const ArgsManager& args);
+    void UpdateAssumeutxoFromArgs(const ArgsManager& args);
 };
 
 void CRegTestParams::UpdateVersionBitsParametersFromArgs(const ArgsManager& args)
@@ -396,6 +404,29 @@ void CRegTestParams::UpdateVersionBitsParametersFromArgs(const ArgsManager& args
     }
 }
 
+void CRegTestParams::UpdateAssumeutxoFromArgs(const ArgsManager& args)
+{
+    for (const std::string& strAssumeutxo : args.GetArgs("-assumeutxo")) {
+        std::vector<std::string> vParams;
+        boost::split(vParams, strAssumeutxo, boost::is_any_of(":"));
+        if (vParams.size() != 3) {
+            throw std::runtime_error("Assumeutxo parameters malformed, expecting height:hash:nchaintx");
+        }
+        int32_t nHeight, nChainTx;
+        if (!ParseInt32(vParams[0], &nHeight) || nHeight < 0) {
+            throw std::runtime_error(strprintf("Invalid height (%s)", vParams[0]));
+        }
+        if (!IsHex(vParams[1]) || vParams[1].size() != 64) {
+            throw std::runtime_error(strprintf("Invalid hash (%s)", vParams[1]));
+        }
+        if (!ParseInt32(vParams[2], &nChainTx) || nChainTx <= nHeight) {
+            throw std::runtime_error(strprintf("Invalid nChainTx (%s)", vParams[2]));
+        }
+        m_assumeutxo_data[nHeight] = AssumeutxoData{uint256S(vParams[1]), (unsigned int)nChainTx};
+        LogPrintf("Trusting UTXO set snapshot at height %d with hash %s\n", nHeight, vParams[1]);
+    }
+}
+
 static std::unique_ptr<const CChainParams> globalChainParams;
 
 const CChainParams &Params() {
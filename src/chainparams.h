@@ -37,6 +37,19 @@ struct ChainTxData {
     double dTxRate;   //!< estimated number of transactions per second after that timestamp
 };
 
+/**
+ * Commitment to a UTXO set snapshot trusted to be loaded with loadtxoutset.
+ */
+struct AssumeutxoData {
+    //! The hash_serialized_2 of gettxoutsetinfo at the snapshot base block
+    uint256 hash_serialized;
+    //! Number of transactions up to and including the base block
+    unsigned int nChainTx;
+};
+
+/** Trusted UTXO set snapshots, by the height of their base block */
+typedef std::map<int, AssumeutxoData> MapAssumeutxo;
+
 /**
  * CChainParams defines various tweakable parameters of a given instance of the
  * Bitcoin system. There are three: the main network on which people trade goods
@@ -85,6 +98,7 @@ public:
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     const CCheckpointData& Checkpoints() const { return checkpointData; }
     const ChainTxData& TxData() const { return chainTxData; }
+    const MapAssumeutxo& Assumeutxo() const { return m_assumeutxo_data; }
 protected:
     CChainParams() {}
 
@@ -105,6 +119,7 @@ protected:
     bool fMineBlocksOnDemand;
     CCheckpointData checkpointData;
     ChainTxData chainTxData;
+    MapAssumeutxo m_assumeutxo_data;
     bool m_fallback_fee_enabled;
 };
 
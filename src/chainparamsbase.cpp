@@ -21,6 +21,7 @@ void SetupChainParamsBaseOptions()
                                    "This is intended for regression testing tools and app development.", true, OptionsCategory::CHAINPARAMS);
     gArgs.AddArg("-testnet", "Use the test chain", false, OptionsCategory::CHAINPARAMS);
     gArgs.AddArg("-vbparams=deployment:start:end", "Use given start/end times for specified version bits deployment (regtest-only)", true, OptionsCategory::CHAINPARAMS);
+    gArgs.AddArg("-assumeutxo=height:hash:nchaintx", "Trust the UTXO set snapshot of the block at this height with the given gettxoutsetinfo hash_serialized_2 and number of transactions for loadtxoutset (regtest-only)", true, OptionsCategory::CHAINPARAMS);
 }
 
 static std::unique_ptr<CBaseChainParams> globalChainBaseParams;
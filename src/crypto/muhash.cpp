@@ -0,0 +1,233 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+
+#include <assert.h>
+#include <limits>
+
+namespace {
+
+using limb_t = Num3072::limb_t;
+using double_limb_t = Num3072::double_limb_t;
+constexpr int LIMB_SIZE = Num3072::LIMB_SIZE;
+constexpr int LIMBS = Num3072::LIMBS;
+/** 2^3072 - 1103717 is the largest 3072-bit safe prime number. */
+constexpr limb_t MAX_PRIME_DIFF = 1103717;
+
+/** Add d times the carry limb to n, the low limbs of a number whose value is n + carry * 2^3072. */
+void FoldCarry(limb_t (&n)[LIMBS], limb_t carry)
+{
+    // 2^3072 is congruent to MAX_PRIME_DIFF; the final carry is at most one,
+    // after which nothing can overflow again.
+    while (carry) {
+        double_limb_t t = (double_limb_t)carry * MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && t; ++i) {
+            t += n[i];
+            n[i] = (limb_t)t;
+            t >>= LIMB_SIZE;
+        }
+        carry = (limb_t)t;
+    }
+}
+
+} // namespace
+
+bool Num3072::IsOverflow() const
+{
+    if (this->limbs[0] <= std::numeric_limits<limb_t>::max() - MAX_PRIME_DIFF) return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (this->limbs[i] != std::numeric_limits<limb_t>::max()) return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the prime is adding MAX_PRIME_DIFF and dropping 2^3072.
+    limb_t c0 = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t t = (double_limb_t)this->limbs[i] + c0;
+        this->limbs[i] = (limb_t)t;
+        c0 = (limb_t)(t >> LIMB_SIZE);
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook product into 6144 bits. Both operands are read before the
+    // result is written, so a may alias this.
+    limb_t tmp[2 * LIMBS] = {0};
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            double_limb_t t = (double_limb_t)this->limbs[i] * a.limbs[j] + tmp[i + j] + carry;
+            tmp[i + j] = (limb_t)t;
+            carry = (limb_t)(t >> LIMB_SIZE);
+        }
+        tmp[i + LIMBS] = carry;
+    }
+
+    // Reduce: high * 2^3072 + low is congruent to high * MAX_PRIME_DIFF + low.
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t t = (double_limb_t)tmp[LIMBS + i] * MAX_PRIME_DIFF + tmp[i] + carry;
+        this->limbs[i] = (limb_t)t;
+        carry = (limb_t)(t >> LIMB_SIZE);
+    }
+    FoldCarry(this->limbs, carry);
+
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::SetToOne()
+{
+    this->limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) {
+        this->limbs[i] = 0;
+    }
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat: the inverse is this^(p - 2), with
+    // p - 2 = 2^3072 - 1103719 = (2^3051 - 1) * 2^21 + 993433.
+    //
+    // this^(2^k - 1) is built up along the bits of 3051, using
+    // this^(2^(2k) - 1) = (this^(2^k - 1))^(2^k) * this^(2^k - 1) and
+    // this^(2^(k+1) - 1) = (this^(2^k - 1))^2 * this.
+    static constexpr int REPUNIT_BITS = 3051;
+    static constexpr uint32_t LOW_EXPONENT = 993433;
+    static constexpr int LOW_BITS = 21;
+
+    Num3072 repunit = *this;
+    int k = 1;
+    int top_bit = 0;
+    while ((REPUNIT_BITS >> (top_bit + 1)) != 0) ++top_bit;
+    for (int bit = top_bit - 1; bit >= 0; --bit) {
+        Num3072 shifted = repunit;
+        for (int i = 0; i < k; ++i) {
+            shifted.Multiply(shifted);
+        }
+        shifted.Multiply(repunit);
+        repunit = shifted;
+        k *= 2;
+        if ((REPUNIT_BITS >> bit) & 1) {
+            repunit.Multiply(repunit);
+            repunit.Multiply(*this);
+            ++k;
+        }
+    }
+    assert(k == REPUNIT_BITS);
+
+    Num3072 out = repunit;
+    for (int i = 0; i < LOW_BITS; ++i) {
+        out.Multiply(out);
+    }
+
+    Num3072 low;
+    for (int bit = LOW_BITS - 1; bit >= 0; --bit) {
+        low.Multiply(low);
+        if ((LOW_EXPONENT >> bit) & 1) low.Multiply(*this);
+    }
+    out.Multiply(low);
+    return out;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    if (this->IsOverflow()) this->FullReduce();
+
+    Num3072 inv{};
+    if (a.IsOverflow()) {
+        Num3072 b = a;
+        b.FullReduce();
+        inv = b.GetInverse();
+    } else {
+        inv = a.GetInverse();
+    }
+
+    this->Multiply(inv);
+    if (this->IsOverflow()) this->FullReduce();
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        if (sizeof(limb_t) == 4) {
+            this->limbs[i] = ReadLE32(data + 4 * i);
+        } else if (sizeof(limb_t) == 8) {
+            this->limbs[i] = ReadLE64(data + 8 * i);
+        }
+    }
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        if (sizeof(limb_t) == 4) {
+            WriteLE32(out + i * 4, this->limbs[i]);
+        } else if (sizeof(limb_t) == 8) {
+            WriteLE64(out + i * 8, this->limbs[i]);
+        }
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(Span<const unsigned char> in)
+{
+    unsigned char tmp[Num3072::BYTE_SIZE];
+
+    uint256 hashed_in;
+    CSHA256().Write(in.data(), in.size()).Finalize(hashed_in.begin());
+    ChaCha20(hashed_in.begin(), hashed_in.size()).Output(tmp, Num3072::BYTE_SIZE);
+    Num3072 out{tmp};
+
+    return out;
+}
+
+MuHash3072::MuHash3072(Span<const unsigned char> in) noexcept
+{
+    m_numerator = ToNum3072(in);
+}
+
+void MuHash3072::Finalize(uint256& out) noexcept
+{
+    m_numerator.Divide(m_denominator);
+    m_denominator.SetToOne();  // Needed to keep the MuHash object valid
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    m_numerator.ToBytes(data);
+
+    CSHA256().Write(data, Num3072::BYTE_SIZE).Finalize(out.begin());
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul) noexcept
+{
+    m_numerator.Multiply(mul.m_numerator);
+    m_denominator.Multiply(mul.m_denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div) noexcept
+{
+    m_numerator.Multiply(div.m_denominator);
+    m_denominator.Multiply(div.m_numerator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::Insert(Span<const unsigned char> in) noexcept
+{
+    m_numerator.Multiply(ToNum3072(in));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(Span<const unsigned char> in) noexcept
+{
+    m_denominator.Multiply(ToNum3072(in));
+    return *this;
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <serialize.h>
+#include <span.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+/** A number modulo the prime 2^3072 - 1103717, stored as little-endian limbs. */
+class Num3072
+{
+private:
+    void FullReduce();
+    bool IsOverflow() const;
+    Num3072 GetInverse() const;
+
+public:
+    static constexpr size_t BYTE_SIZE = 384;
+
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 double_limb_t;
+    typedef uint64_t limb_t;
+    static constexpr int LIMBS = 48;
+    static constexpr int LIMB_SIZE = 64;
+#else
+    typedef uint64_t double_limb_t;
+    typedef uint32_t limb_t;
+    static constexpr int LIMBS = 96;
+    static constexpr int LIMB_SIZE = 32;
+#endif
+    limb_t limbs[LIMBS];
+
+    // Sanity check for Num3072 constants
+    static_assert(LIMB_SIZE * LIMBS == 3072, "Num3072 isn't 3072 bits");
+    static_assert(sizeof(double_limb_t) == sizeof(limb_t) * 2, "bad size for double_limb_t");
+    static_assert(sizeof(limb_t) * 8 == LIMB_SIZE, "LIMB_SIZE is incorrect");
+
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    void SetToOne();
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+    Num3072() { SetToOne(); }
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        for (limb_t& limb : limbs) {
+            READWRITE(limb);
+        }
+    }
+};
+
+/**
+ * A multiplicative hash of a set of byte strings, which can be updated
+ * incrementally: adding and removing elements is commutative, so the result
+ * only depends on the current contents of the set, not on the order in which
+ * it was built.
+ *
+ * Each element is hashed with SHA256, expanded to a 3072-bit number with
+ * ChaCha20 and multiplied into the numerator (insertion) or denominator
+ * (removal) modulo a prime. Finalize() divides them, which needs a modular
+ * inverse and is far slower than an insertion, and returns the SHA256 of the
+ * resulting number. Keeping numerator and denominator apart means that
+ * inverse is computed once per Finalize() rather than once per removal.
+ */
+class MuHash3072
+{
+private:
+    Num3072 m_numerator;
+    Num3072 m_denominator;
+
+    Num3072 ToNum3072(Span<const unsigned char> in);
+
+public:
+    /** The empty set. */
+    MuHash3072() noexcept {}
+
+    /** A singleton with the given element. */
+    explicit MuHash3072(Span<const unsigned char> in) noexcept;
+
+    /** Insert a single element into the set. */
+    MuHash3072& Insert(Span<const unsigned char> in) noexcept;
+
+    /** Remove a single element from the set. */
+    MuHash3072& Remove(Span<const unsigned char> in) noexcept;
+
+    /** Multiply (union of the sets of) another MuHash3072 into this one. */
+    MuHash3072& operator*=(const MuHash3072& mul) noexcept;
+
+    /** Divide (remove the set of) another MuHash3072 from this one. */
+    MuHash3072& operator/=(const MuHash3072& div) noexcept;
+
+    /** Finalize into a 32-byte hash. Does not change the set the object represents. */
+    void Finalize(uint256& out) noexcept;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(m_numerator);
+        READWRITE(m_denominator);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -2220,6 +2220,39 @@ static void neoscrypt_blkmix(unsigned int *X, unsigned int *Y, unsigned int r, u
 }
 
 
+void neoscrypt_ctx_init(neoscrypt_ctx *ctx) {
+    ctx->buffer = NULL;
+    ctx->scratch = NULL;
+    ctx->size = 0;
+}
+
+void neoscrypt_ctx_free(neoscrypt_ctx *ctx) {
+    free(ctx->buffer);
+    neoscrypt_ctx_init(ctx);
+}
+
+/* Makes sure the scratchpad holds at least size bytes, 64-byte aligned */
+static int neoscrypt_ctx_reserve(neoscrypt_ctx *ctx, size_t size) {
+    const size_t align = 0x40;
+    void *buffer;
+
+    if(ctx->size >= size)
+        return(0);
+
+    if(size > SIZE_MAX - align)
+        return(-1);
+    buffer = malloc(size + align);
+    if(!buffer)
+        return(-1);
+
+    free(ctx->buffer);
+    ctx->buffer = buffer;
+    ctx->scratch = (unsigned int *) (((size_t)buffer + align - 1) & ~(align - 1));
+    ctx->size = size;
+
+    return(0);
+}
+
 /* NeoScrypt core engine:
  * p = 1, salt = password;
  * Basic customisation (required):
@@ -2251,10 +2284,11 @@ static void neoscrypt_blkmix(unsigned int *X, unsigned int *Y, unsigned int r, u
  *     .....
  *     11110 = N of 2147483648;
  *   profile bits 30 to 13 are reserved */
-void neoscrypt(const unsigned char *password, unsigned char *output, unsigned int profile) {
-    const size_t stack_align = 0x40;
+int neoscrypt_ctx_hash(neoscrypt_ctx *ctx, const unsigned char *password,
+  unsigned char *output, unsigned int profile) {
     unsigned int N = 128, r = 2, dblmix = 1, mixmode = 0x14;
-    unsigned int kdf, i, j;
+    unsigned int kdf, i;
+    size_t j, words, size;
     unsigned int *X, *Y, *Z, *V;
 
     if(profile & 0x1) {
@@ -2265,13 +2299,22 @@ void neoscrypt(const unsigned char *password, unsigned char *output, unsigned in
     }
 
     if(profile >> 31) {
-        N = (1 << (((profile >> 8) & 0x1F) + 1));
-        r = (1 << ((profile >> 5) & 0x7));
+        if(((profile >> 8) & 0x1F) == 0x1F)
+            return(-1);
+        N = (1U << (((profile >> 8) & 0x1F) + 1));
+        r = (1U << ((profile >> 5) & 0x7));
     }
 
-    unsigned char stack[(N + 3) * r * 2 * BLOCK_SIZE + stack_align];
+    /* (N + 3) * r * 2 * BLOCK_SIZE */
+    words = (size_t)32 * r;
+    if((size_t)N + 3 > SIZE_MAX / (words * 4))
+        return(-1);
+    size = ((size_t)N + 3) * words * 4;
+    if(neoscrypt_ctx_reserve(ctx, size))
+        return(-1);
+
     /* X = r * 2 * BLOCK_SIZE */
-    X = (unsigned int *) (((size_t)stack & ~(stack_align - 1)) + stack_align);
+    X = ctx->scratch;
     /* Z is a copy of X for ChaCha */
     Z = &X[32 * r];
     /* Y is an X sized temporal space */
@@ -2310,14 +2353,14 @@ void neoscrypt(const unsigned char *password, unsigned char *output, unsigned in
         /* Z = SMix(Z) */
         for(i = 0; i < N; i++) {
             /* blkcpy(V, Z) */
-            neoscrypt_blkcpy(&V[i * (32 * r)], &Z[0], r * 2 * BLOCK_SIZE);
+            neoscrypt_blkcpy(&V[i * words], &Z[0], r * 2 * BLOCK_SIZE);
             /* blkmix(Z, Y) */
             neoscrypt_blkmix(&Z[0], &Y[0], r, (mixmode | 0x0100));
         }
 
         for(i = 0; i < N; i++) {
             /* integerify(Z) mod N */
-            j = (32 * r) * (Z[16 * (2 * r - 1)] & (N - 1));
+            j = words * (Z[16 * (2 * r - 1)] & (N - 1));
             /* blkxor(Z, V) */
             neoscrypt_blkxor(&Z[0], &V[j], r * 2 * BLOCK_SIZE);
             /* blkmix(Z, Y) */
@@ -2328,13 +2371,13 @@ void neoscrypt(const unsigned char *password, unsigned char *output, unsigned in
     /* X = SMix(X) */
     for(i = 0; i < N; i++) {
         /* blkcpy(V, X) */
-        neoscrypt_blkcpy(&V[i * (32 * r)], &X[0], r * 2 * BLOCK_SIZE);
+        neoscrypt_blkcpy(&V[i * words], &X[0], r * 2 * BLOCK_SIZE);
         /* blkmix(X, Y) */
         neoscrypt_blkmix(&X[0], &Y[0], r, mixmode);
     }
     for(i = 0; i < N; i++) {
         /* integerify(X) mod N */
-        j = (32 * r) * (X[16 * (2 * r - 1)] & (N - 1));
+        j = words * (X[16 * (2 * r - 1)] & (N - 1));
         /* blkxor(X, V) */
         neoscrypt_blkxor(&X[0], &V[j], r * 2 * BLOCK_SIZE);
         /* blkmix(X, Y) */
@@ -2365,4 +2408,5 @@ void neoscrypt(const unsigned char *password, unsigned char *output, unsigned in
 
     }
 
+    return(0);
 }
@@ -1,10 +1,41 @@
+#ifndef NEOSCRYPT_H
+#define NEOSCRYPT_H
+
+#include <stddef.h>
+
 #if (__cplusplus)
 extern "C" {
 #endif
 
+/* A reusable NeoScrypt scratchpad, 64-byte aligned and grown on demand */
+typedef struct {
+    void *buffer;
+    unsigned int *scratch;
+    size_t size;
+} neoscrypt_ctx;
+
+void neoscrypt_ctx_init(neoscrypt_ctx *ctx);
+void neoscrypt_ctx_free(neoscrypt_ctx *ctx);
+
+/* NeoScrypt using the scratchpad of ctx; returns 0 on success or -1 if
+ * the profile asks for a scratchpad that cannot be allocated */
+int neoscrypt_ctx_hash(neoscrypt_ctx *ctx, const unsigned char *password,
+  unsigned char *output, unsigned int profile);
+
+/* NeoScrypt using a per-thread scratchpad; if that cannot be allocated,
+ * one for this call only. Profiles that cannot be hashed at all give a
+ * hash of all ones. */
 void neoscrypt(const unsigned char *password, unsigned char *output,
   unsigned int profile);
 
+void neoscrypt_fastkdf(const unsigned char *password, unsigned int password_len,
+  const unsigned char *salt, unsigned int salt_len, unsigned int N,
+  unsigned char *output, unsigned int output_len);
+
+void neoscrypt_pbkdf2_sha256(const unsigned char *password, unsigned int password_len,
+  const unsigned char *salt, unsigned int salt_len, unsigned int N,
+  unsigned char *output, unsigned int output_len);
+
 void neoscrypt_blake2s(const void *input, const unsigned int input_size,
   const void *key, const unsigned char key_size,
   void *output, const unsigned char output_size);
@@ -15,6 +46,23 @@ void neoscrypt_xor(void *dstp, const void *srcp, unsigned int len);
 
 #if (__cplusplus)
 }
+
+#include <string>
+
+/** Autodetect the best available multi-lane NeoScrypt engine.
+ *  Returns the name of the implementation.
+ */
+std::string NeoScryptAutoDetect();
+
+/** Compute multiple NeoScrypt hashes of 80-byte block headers.
+ *  input:   pointer to a count*80 byte input buffer
+ *  output:  pointer to a count*32 byte output buffer
+ *  count:   the number of hashes to compute
+ *  profile: the NeoScrypt profile, as for neoscrypt()
+ */
+void neoscrypt_multi(const unsigned char *input, unsigned char *output,
+  unsigned int count, unsigned int profile);
+
 #else
 
 #ifndef MIN
@@ -45,4 +93,6 @@ typedef unsigned char hash_digest[DIGEST_SIZE];
     U32TO8_BE((p),     (unsigned int)((v) >> 32)); \
     U32TO8_BE((p) + 4, (unsigned int)((v)      ));
 
-#endif
\ No newline at end of file
+#endif
+
+#endif /* NEOSCRYPT_H */
@@ -0,0 +1,145 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// 8-way interleaved NeoScrypt SMix: every 32-bit word of the state is kept
+// in a vector whose lanes belong to eight independent hashes.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace neoscrypt_avx2 {
+namespace {
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline RotL(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n)); }
+__m256i inline RotL16(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2, 13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2)); }
+__m256i inline RotL8(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3, 14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3)); }
+
+/** Salsa20 on 8 lanes, rounds must be a multiple of 2 */
+void inline Salsa(__m256i* X, unsigned int rounds)
+{
+    __m256i x0 = X[0], x1 = X[1], x2 = X[2], x3 = X[3];
+    __m256i x4 = X[4], x5 = X[5], x6 = X[6], x7 = X[7];
+    __m256i x8 = X[8], x9 = X[9], x10 = X[10], x11 = X[11];
+    __m256i x12 = X[12], x13 = X[13], x14 = X[14], x15 = X[15];
+
+#define QUARTER(a, b, c, d) \
+    b = Xor(b, RotL(Add(a, d), 7)); \
+    c = Xor(c, RotL(Add(b, a), 9)); \
+    d = Xor(d, RotL(Add(c, b), 13)); \
+    a = Xor(a, RotL(Add(d, c), 18));
+
+    for (; rounds; rounds -= 2) {
+        QUARTER( x0,  x4,  x8, x12);
+        QUARTER( x5,  x9, x13,  x1);
+        QUARTER(x10, x14,  x2,  x6);
+        QUARTER(x15,  x3,  x7, x11);
+        QUARTER( x0,  x1,  x2,  x3);
+        QUARTER( x5,  x6,  x7,  x4);
+        QUARTER(x10, x11,  x8,  x9);
+        QUARTER(x15, x12, x13, x14);
+    }
+
+#undef QUARTER
+
+    X[0] = Add(X[0], x0); X[1] = Add(X[1], x1); X[2] = Add(X[2], x2); X[3] = Add(X[3], x3);
+    X[4] = Add(X[4], x4); X[5] = Add(X[5], x5); X[6] = Add(X[6], x6); X[7] = Add(X[7], x7);
+    X[8] = Add(X[8], x8); X[9] = Add(X[9], x9); X[10] = Add(X[10], x10); X[11] = Add(X[11], x11);
+    X[12] = Add(X[12], x12); X[13] = Add(X[13], x13); X[14] = Add(X[14], x14); X[15] = Add(X[15], x15);
+}
+
+/** ChaCha20 on 8 lanes, rounds must be a multiple of 2 */
+void inline ChaCha(__m256i* X, unsigned int rounds)
+{
+    __m256i x0 = X[0], x1 = X[1], x2 = X[2], x3 = X[3];
+    __m256i x4 = X[4], x5 = X[5], x6 = X[6], x7 = X[7];
+    __m256i x8 = X[8], x9 = X[9], x10 = X[10], x11 = X[11];
+    __m256i x12 = X[12], x13 = X[13], x14 = X[14], x15 = X[15];
+
+#define QUARTER(a, b, c, d) \
+    a = Add(a, b); d = RotL16(Xor(d, a)); \
+    c = Add(c, d); b = RotL(Xor(b, c), 12); \
+    a = Add(a, b); d = RotL8(Xor(d, a)); \
+    c = Add(c, d); b = RotL(Xor(b, c), 7);
+
+    for (; rounds; rounds -= 2) {
+        QUARTER( x0,  x4,  x8, x12);
+        QUARTER( x1,  x5,  x9, x13);
+        QUARTER( x2,  x6, x10, x14);
+        QUARTER( x3,  x7, x11, x15);
+        QUARTER( x0,  x5, x10, x15);
+        QUARTER( x1,  x6, x11, x12);
+        QUARTER( x2,  x7,  x8, x13);
+        QUARTER( x3,  x4,  x9, x14);
+    }
+
+#undef QUARTER
+
+    X[0] = Add(X[0], x0); X[1] = Add(X[1], x1); X[2] = Add(X[2], x2); X[3] = Add(X[3], x3);
+    X[4] = Add(X[4], x4); X[5] = Add(X[5], x5); X[6] = Add(X[6], x6); X[7] = Add(X[7], x7);
+    X[8] = Add(X[8], x8); X[9] = Add(X[9], x9); X[10] = Add(X[10], x10); X[11] = Add(X[11], x11);
+    X[12] = Add(X[12], x12); X[13] = Add(X[13], x13); X[14] = Add(X[14], x14); X[15] = Add(X[15], x15);
+}
+
+/** The NeoScrypt block mixer, see neoscrypt_blkmix() */
+void inline BlkMix(__m256i* X, __m256i* Y, unsigned int r, unsigned int mixmode)
+{
+    const unsigned int rounds = mixmode & 0xFF;
+    const bool chacha = (mixmode >> 8) != 0;
+
+    for (unsigned int i = 0; i < 2 * r; i++) {
+        const __m256i* prev = &X[16 * (i ? i - 1 : 2 * r - 1)];
+        __m256i* cur = &X[16 * i];
+        for (int k = 0; k < 16; k++) cur[k] = Xor(cur[k], prev[k]);
+        if (chacha) {
+            ChaCha(cur, rounds);
+        } else {
+            Salsa(cur, rounds);
+        }
+        if (r > 1) {
+            for (int k = 0; k < 16; k++) Y[16 * i + k] = cur[k];
+        }
+    }
+    if (r > 1) {
+        for (unsigned int i = 0; i < r; i++) {
+            for (int k = 0; k < 16; k++) {
+                X[16 * i + k] = Y[16 * (2 * i) + k];
+                X[16 * (i + r) + k] = Y[16 * (2 * i + 1) + k];
+            }
+        }
+    }
+}
+
+}
+
+void SMix_8way(uint32_t* Xw, uint32_t* Vw, uint32_t* Yw, unsigned int N, unsigned int r, unsigned int mixmode)
+{
+    __m256i* X = (__m256i*)Xw;
+    __m256i* V = (__m256i*)Vw;
+    __m256i* Y = (__m256i*)Yw;
+    const unsigned int words = 32 * r;
+
+    for (unsigned int i = 0; i < N; i++) {
+        for (unsigned int k = 0; k < words; k++) V[i * words + k] = X[k];
+        BlkMix(X, Y, r, mixmode);
+    }
+    for (unsigned int i = 0; i < N; i++) {
+        // integerify(X) mod N, separately for every lane
+        const uint32_t* last = &Xw[16 * (2 * r - 1) * 8];
+        const uint32_t* v[8];
+        for (int l = 0; l < 8; l++) v[l] = &Vw[(last[l] & (N - 1)) * words * 8];
+        for (unsigned int k = 0; k < words; k++) {
+            X[k] = Xor(X[k], _mm256_set_epi32(v[7][8 * k + 7], v[6][8 * k + 6], v[5][8 * k + 5], v[4][8 * k + 4],
+                                              v[3][8 * k + 3], v[2][8 * k + 2], v[1][8 * k + 1], v[0][8 * k]));
+        }
+        BlkMix(X, Y, r, mixmode);
+    }
+}
+
+}
+
+#endif
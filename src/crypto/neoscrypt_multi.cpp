@@ -0,0 +1,283 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/neoscrypt.h>
+#include <crypto/common.h>
+
+#include <assert.h>
+#include <string.h>
+#include <memory>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#if defined(USE_ASM)
+#include <cpuid.h>
+#endif
+#endif
+
+namespace neoscrypt_sse2
+{
+void SMix_4way(uint32_t* X, uint32_t* V, uint32_t* Y, unsigned int N, unsigned int r, unsigned int mixmode);
+}
+
+namespace neoscrypt_avx2
+{
+void SMix_8way(uint32_t* X, uint32_t* V, uint32_t* Y, unsigned int N, unsigned int r, unsigned int mixmode);
+}
+
+namespace {
+
+/** Size of a NeoScrypt password (a serialized block header) */
+static const unsigned int PASSWORD_SIZE = 80;
+/** Size of a NeoScrypt hash */
+static const unsigned int HASH_SIZE = 32;
+
+typedef void (*SMixType)(uint32_t*, uint32_t*, uint32_t*, unsigned int, unsigned int, unsigned int);
+
+SMixType SMix_4way = nullptr;
+SMixType SMix_8way = nullptr;
+
+/** NeoScrypt parameters derived from a profile, see neoscrypt_ctx_hash() */
+struct Parameters
+{
+    unsigned int N = 128;
+    unsigned int r = 2;
+    bool dblmix = true;
+    unsigned int mixmode = 0x14;
+    unsigned int kdf = 0;
+
+    explicit Parameters(unsigned int profile)
+    {
+        if (profile & 0x1) {
+            N = 1024;
+            r = 1;
+            dblmix = false;
+            mixmode = 0x08;
+        }
+        kdf = (profile >> 1) & 0xF;
+    }
+};
+
+void KDF(const Parameters& params, const unsigned char* password, const unsigned char* salt, unsigned int salt_len, unsigned char* output, unsigned int output_len)
+{
+    if (params.kdf == 0x1) {
+        neoscrypt_pbkdf2_sha256(password, PASSWORD_SIZE, salt, salt_len, 1, output, output_len);
+    } else {
+        neoscrypt_fastkdf(password, PASSWORD_SIZE, salt, salt_len, 32, output, output_len);
+    }
+}
+
+/** Per-thread scratchpad of HashLanes(), 64-byte aligned and reused between calls */
+uint32_t* LaneScratch(size_t words)
+{
+    static thread_local std::unique_ptr<uint32_t[]> buffer;
+    static thread_local size_t capacity = 0;
+    if (capacity < words) {
+        buffer.reset(new uint32_t[words + 16]);
+        capacity = words;
+    }
+    return (uint32_t*)(((size_t)buffer.get() + 63) & ~(size_t)63);
+}
+
+/** The standard profiles need at most this much scratchpad */
+const size_t STANDARD_SCRATCH_SIZE = (1024 + 3) * 2 * 64;
+
+/** Per-thread scratchpad of neoscrypt(), reused between calls and freed at thread exit */
+struct ThreadContext
+{
+    neoscrypt_ctx ctx;
+
+    ThreadContext() { neoscrypt_ctx_init(&ctx); }
+    ~ThreadContext() { neoscrypt_ctx_free(&ctx); }
+};
+
+/** neoscrypt() without the per-thread scratchpad: on the stack, or for larger
+ *  extended profiles on the heap for this call only */
+void HashWithoutThreadContext(const unsigned char* password, unsigned char* output, unsigned int profile)
+{
+    alignas(64) unsigned char stack[STANDARD_SCRATCH_SIZE];
+    neoscrypt_ctx ctx;
+    ctx.buffer = nullptr;
+    ctx.scratch = (unsigned int*)stack;
+    ctx.size = sizeof(stack);
+    if (neoscrypt_ctx_hash(&ctx, password, output, profile)) {
+        // No hash can be computed; all ones meets no proof of work target
+        memset(output, 0xff, HASH_SIZE);
+    }
+    neoscrypt_ctx_free(&ctx);
+}
+
+/** Hash 'lanes' headers at once: the KDFs run per hash, SMix on interleaved state. */
+template<unsigned int lanes>
+void HashLanes(SMixType smix, const Parameters& params, const unsigned char* input, unsigned char* output)
+{
+    const unsigned int words = 32 * params.r;
+    const size_t state_words = (size_t)words * lanes;
+    const size_t total_words = state_words * (3 + (size_t)params.N);
+
+    uint32_t* X = LaneScratch(total_words);
+    uint32_t* Z = X + state_words;
+    uint32_t* Y = Z + state_words;
+    uint32_t* V = Y + state_words;
+    uint32_t lane[32 * 2];
+
+    // X = KDF(password, salt), interleaved word by word
+    for (unsigned int l = 0; l < lanes; l++) {
+        const unsigned char* password = input + l * PASSWORD_SIZE;
+        KDF(params, password, password, PASSWORD_SIZE, (unsigned char*)lane, words * 4);
+        for (unsigned int w = 0; w < words; w++) X[w * lanes + l] = lane[w];
+    }
+
+    // ChaCha 1st, Salsa 2nd and XOR them together; otherwise Salsa only
+    if (params.dblmix) {
+        memcpy(Z, X, state_words * 4);
+        smix(Z, V, Y, params.N, params.r, params.mixmode | 0x0100);
+    }
+    smix(X, V, Y, params.N, params.r, params.mixmode);
+    if (params.dblmix) {
+        for (size_t i = 0; i < state_words; i++) X[i] ^= Z[i];
+    }
+
+    // output = KDF(password, X)
+    for (unsigned int l = 0; l < lanes; l++) {
+        for (unsigned int w = 0; w < words; w++) lane[w] = X[w * lanes + l];
+        KDF(params, input + l * PASSWORD_SIZE, (const unsigned char*)lane, words * 4, output + l * HASH_SIZE, HASH_SIZE);
+    }
+}
+
+bool SelfTest()
+{
+    // Enough headers to go through every engine and the scalar tail
+    static const unsigned int count = 13;
+    static const unsigned int profiles[] = {0x0, 0x3};
+    unsigned char input[count * PASSWORD_SIZE];
+    unsigned char output[count * HASH_SIZE];
+    unsigned char expected[HASH_SIZE];
+
+    for (unsigned int i = 0; i < sizeof(input); i++) input[i] = (unsigned char)(i * 7 + 1);
+    for (unsigned int profile : profiles) {
+        neoscrypt_multi(input, output, count, profile);
+        for (unsigned int i = 0; i < count; i++) {
+            neoscrypt(input + i * PASSWORD_SIZE, expected, profile);
+            if (memcmp(output + i * HASH_SIZE, expected, HASH_SIZE)) return false;
+        }
+    }
+    return true;
+}
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+// We can't use cpuid.h's __get_cpuid as it does not support subleafs.
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+#ifdef __GNUC__
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+#else
+  __asm__ ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(subleaf));
+#endif
+}
+
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+/** Pick the engines for this CPU, and check them against the reference code */
+std::string SetUpEngines()
+{
+    std::string ret = "standard";
+
+#if defined(__SSE2__)
+    SMix_4way = neoscrypt_sse2::SMix_4way;
+    ret = "sse2(4way)";
+#endif
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+    bool have_xsave = false;
+    bool have_avx = false;
+    bool have_avx2 = false;
+    bool enabled_avx = false;
+
+    (void)AVXEnabled;
+    (void)have_avx2;
+    (void)enabled_avx;
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    have_xsave = (ecx >> 27) & 1;
+    have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx) {
+        enabled_avx = AVXEnabled();
+        cpuid(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = (ebx >> 5) & 1;
+    }
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2 && have_avx && enabled_avx) {
+        SMix_8way = neoscrypt_avx2::SMix_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+} // namespace
+
+std::string NeoScryptAutoDetect()
+{
+    // The choice only depends on the CPU, so set up and self-test once per process.
+    static const std::string ret = SetUpEngines();
+    return ret;
+}
+
+void neoscrypt(const unsigned char* password, unsigned char* output, unsigned int profile)
+{
+    static thread_local ThreadContext thread_context;
+    neoscrypt_ctx* ctx = &thread_context.ctx;
+
+    if (neoscrypt_ctx_hash(ctx, password, output, profile) == 0) {
+        // Larger scratchpads of extended profiles are not kept between calls
+        if (ctx->size > STANDARD_SCRATCH_SIZE) neoscrypt_ctx_free(ctx);
+        return;
+    }
+    // The scratchpad could not grow: give it back and hash without it
+    neoscrypt_ctx_free(ctx);
+    HashWithoutThreadContext(password, output, profile);
+}
+
+void neoscrypt_multi(const unsigned char* input, unsigned char* output, unsigned int count, unsigned int profile)
+{
+    const Parameters params(profile);
+
+    // Extended profiles may ask for scratchpads far larger than the
+    // interleaved engines are meant for; leave those to the reference code.
+    if (!(profile >> 31)) {
+        if (SMix_8way) {
+            while (count >= 8) {
+                HashLanes<8>(SMix_8way, params, input, output);
+                input += 8 * PASSWORD_SIZE;
+                output += 8 * HASH_SIZE;
+                count -= 8;
+            }
+        }
+        if (SMix_4way) {
+            while (count >= 4) {
+                HashLanes<4>(SMix_4way, params, input, output);
+                input += 4 * PASSWORD_SIZE;
+                output += 4 * HASH_SIZE;
+                count -= 4;
+            }
+        }
+    }
+    while (count) {
+        neoscrypt(input, output, profile);
+        input += PASSWORD_SIZE;
+        output += HASH_SIZE;
+        count -= 1;
+    }
+}
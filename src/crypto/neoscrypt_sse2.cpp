@@ -0,0 +1,144 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// 4-way interleaved NeoScrypt SMix: every 32-bit word of the state is kept
+// in a vector whose lanes belong to four independent hashes.
+
+#ifdef __SSE2__
+
+#include <stdint.h>
+#include <emmintrin.h>
+
+namespace neoscrypt_sse2 {
+namespace {
+
+__m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+__m128i inline RotL(__m128i x, int n) { return _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n)); }
+
+/** Salsa20 on 4 lanes, rounds must be a multiple of 2 */
+void inline Salsa(__m128i* X, unsigned int rounds)
+{
+    __m128i x0 = X[0], x1 = X[1], x2 = X[2], x3 = X[3];
+    __m128i x4 = X[4], x5 = X[5], x6 = X[6], x7 = X[7];
+    __m128i x8 = X[8], x9 = X[9], x10 = X[10], x11 = X[11];
+    __m128i x12 = X[12], x13 = X[13], x14 = X[14], x15 = X[15];
+
+#define QUARTER(a, b, c, d) \
+    b = Xor(b, RotL(Add(a, d), 7)); \
+    c = Xor(c, RotL(Add(b, a), 9)); \
+    d = Xor(d, RotL(Add(c, b), 13)); \
+    a = Xor(a, RotL(Add(d, c), 18));
+
+    for (; rounds; rounds -= 2) {
+        QUARTER( x0,  x4,  x8, x12);
+        QUARTER( x5,  x9, x13,  x1);
+        QUARTER(x10, x14,  x2,  x6);
+        QUARTER(x15,  x3,  x7, x11);
+        QUARTER( x0,  x1,  x2,  x3);
+        QUARTER( x5,  x6,  x7,  x4);
+        QUARTER(x10, x11,  x8,  x9);
+        QUARTER(x15, x12, x13, x14);
+    }
+
+#undef QUARTER
+
+    X[0] = Add(X[0], x0); X[1] = Add(X[1], x1); X[2] = Add(X[2], x2); X[3] = Add(X[3], x3);
+    X[4] = Add(X[4], x4); X[5] = Add(X[5], x5); X[6] = Add(X[6], x6); X[7] = Add(X[7], x7);
+    X[8] = Add(X[8], x8); X[9] = Add(X[9], x9); X[10] = Add(X[10], x10); X[11] = Add(X[11], x11);
+    X[12] = Add(X[12], x12); X[13] = Add(X[13], x13); X[14] = Add(X[14], x14); X[15] = Add(X[15], x15);
+}
+
+/** ChaCha20 on 4 lanes, rounds must be a multiple of 2 */
+void inline ChaCha(__m128i* X, unsigned int rounds)
+{
+    __m128i x0 = X[0], x1 = X[1], x2 = X[2], x3 = X[3];
+    __m128i x4 = X[4], x5 = X[5], x6 = X[6], x7 = X[7];
+    __m128i x8 = X[8], x9 = X[9], x10 = X[10], x11 = X[11];
+    __m128i x12 = X[12], x13 = X[13], x14 = X[14], x15 = X[15];
+
+#define QUARTER(a, b, c, d) \
+    a = Add(a, b); d = RotL(Xor(d, a), 16); \
+    c = Add(c, d); b = RotL(Xor(b, c), 12); \
+    a = Add(a, b); d = RotL(Xor(d, a), 8); \
+    c = Add(c, d); b = RotL(Xor(b, c), 7);
+
+    for (; rounds; rounds -= 2) {
+        QUARTER( x0,  x4,  x8, x12);
+        QUARTER( x1,  x5,  x9, x13);
+        QUARTER( x2,  x6, x10, x14);
+        QUARTER( x3,  x7, x11, x15);
+        QUARTER( x0,  x5, x10, x15);
+        QUARTER( x1,  x6, x11, x12);
+        QUARTER( x2,  x7,  x8, x13);
+        QUARTER( x3,  x4,  x9, x14);
+    }
+
+#undef QUARTER
+
+    X[0] = Add(X[0], x0); X[1] = Add(X[1], x1); X[2] = Add(X[2], x2); X[3] = Add(X[3], x3);
+    X[4] = Add(X[4], x4); X[5] = Add(X[5], x5); X[6] = Add(X[6], x6); X[7] = Add(X[7], x7);
+    X[8] = Add(X[8], x8); X[9] = Add(X[9], x9); X[10] = Add(X[10], x10); X[11] = Add(X[11], x11);
+    X[12] = Add(X[12], x12); X[13] = Add(X[13], x13); X[14] = Add(X[14], x14); X[15] = Add(X[15], x15);
+}
+
+/** The NeoScrypt block mixer, see neoscrypt_blkmix() */
+void inline BlkMix(__m128i* X, __m128i* Y, unsigned int r, unsigned int mixmode)
+{
+    const unsigned int rounds = mixmode & 0xFF;
+    const bool chacha = (mixmode >> 8) != 0;
+
+    for (unsigned int i = 0; i < 2 * r; i++) {
+        const __m128i* prev = &X[16 * (i ? i - 1 : 2 * r - 1)];
+        __m128i* cur = &X[16 * i];
+        for (int k = 0; k < 16; k++) cur[k] = Xor(cur[k], prev[k]);
+        if (chacha) {
+            ChaCha(cur, rounds);
+        } else {
+            Salsa(cur, rounds);
+        }
+        if (r > 1) {
+            for (int k = 0; k < 16; k++) Y[16 * i + k] = cur[k];
+        }
+    }
+    if (r > 1) {
+        for (unsigned int i = 0; i < r; i++) {
+            for (int k = 0; k < 16; k++) {
+                X[16 * i + k] = Y[16 * (2 * i) + k];
+                X[16 * (i + r) + k] = Y[16 * (2 * i + 1) + k];
+            }
+        }
+    }
+}
+
+}
+
+void SMix_4way(uint32_t* Xw, uint32_t* Vw, uint32_t* Yw, unsigned int N, unsigned int r, unsigned int mixmode)
+{
+    __m128i* X = (__m128i*)Xw;
+    __m128i* V = (__m128i*)Vw;
+    __m128i* Y = (__m128i*)Yw;
+    const unsigned int words = 32 * r;
+
+    for (unsigned int i = 0; i < N; i++) {
+        for (unsigned int k = 0; k < words; k++) V[i * words + k] = X[k];
+        BlkMix(X, Y, r, mixmode);
+    }
+    for (unsigned int i = 0; i < N; i++) {
+        // integerify(X) mod N, separately for every lane
+        const uint32_t* last = &Xw[16 * (2 * r - 1) * 4];
+        const uint32_t* v0 = &Vw[(last[0] & (N - 1)) * words * 4];
+        const uint32_t* v1 = &Vw[(last[1] & (N - 1)) * words * 4];
+        const uint32_t* v2 = &Vw[(last[2] & (N - 1)) * words * 4];
+        const uint32_t* v3 = &Vw[(last[3] & (N - 1)) * words * 4];
+        for (unsigned int k = 0; k < words; k++) {
+            X[k] = Xor(X[k], _mm_set_epi32(v3[4 * k + 3], v2[4 * k + 2], v1[4 * k + 1], v0[4 * k]));
+        }
+        BlkMix(X, Y, r, mixmode);
+    }
+}
+
+}
+
+#endif
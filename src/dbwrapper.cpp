@@ -6,6 +6,7 @@
 
 #include <memory>
 #include <random.h>
+#include <sync.h>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -13,6 +14,7 @@
 #include <memenv.h>
 #include <stdint.h>
 #include <algorithm>
+#include <set>
 
 class CBitcoinLevelDBLogger : public leveldb::Logger {
 public:
@@ -97,13 +99,72 @@ static void SetMaxOpenFiles(leveldb::Options *options) {
              options->max_open_files, default_open_files);
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+namespace {
+
+struct DBProfileSettings {
+    const char* name;
+    //! Share of the cache for the block cache, in percent
+    int block_cache_percent;
+    //! Share of the cache for each write buffer, in percent; up to two write
+    //! buffers may be held in memory simultaneously
+    int write_buffer_percent;
+    size_t block_size;
+    //! Bits per key of the bloom filter, or 0 for none
+    int bloom_bits_per_key;
+    leveldb::CompressionType compression;
+    size_t max_file_size;
+};
+
+/**
+ * Coins are looked up at random and their keys are spread over the whole
+ * database, so the chainstate keeps small blocks and a bloom filter, and
+ * larger table files for fewer, bigger compactions. Its values are
+ * obfuscated, which leaves little for compression to find.
+ *
+ * The block tree is small and mostly served from the block cache, while
+ * the indexes are written in block order and rarely read, so the indexes
+ * give most of their cache to the write buffers. None ask for compression:
+ * the bundled LevelDB is built without Snappy and would store the
+ * blocks uncompressed anyway.
+ */
+const DBProfileSettings& GetProfileSettings(DBProfile profile)
+{
+    static const DBProfileSettings DEFAULT = {"default", 50, 25, 4 << 10, 10, leveldb::kNoCompression, 2 << 20};
+    static const DBProfileSettings CHAINSTATE = {"chainstate", 50, 25, 4 << 10, 10, leveldb::kNoCompression, 32 << 20};
+    static const DBProfileSettings BLOCK_TREE = {"blocktree", 50, 25, 16 << 10, 10, leveldb::kNoCompression, 2 << 20};
+    static const DBProfileSettings INDEX = {"index", 20, 40, 16 << 10, 10, leveldb::kNoCompression, 32 << 20};
+
+    switch (profile) {
+    case DBProfile::DEFAULT: return DEFAULT;
+    case DBProfile::CHAINSTATE: return CHAINSTATE;
+    case DBProfile::BLOCK_TREE: return BLOCK_TREE;
+    case DBProfile::INDEX: return INDEX;
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
+Mutex g_open_dbs_mutex;
+std::set<const CDBWrapper*> g_open_dbs GUARDED_BY(g_open_dbs_mutex);
+
+} // namespace
+
+std::string DBProfileName(DBProfile profile)
+{
+    return GetProfileSettings(profile).name;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, DBProfile profile)
 {
+    const DBProfileSettings& settings = GetProfileSettings(profile);
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
+    options.block_cache = leveldb::NewLRUCache(nCacheSize * settings.block_cache_percent / 100);
+    options.write_buffer_size = nCacheSize * settings.write_buffer_percent / 100;
+    options.block_size = settings.block_size;
+    if (settings.bloom_bits_per_key > 0) {
+        options.filter_policy = leveldb::NewBloomFilterPolicy(settings.bloom_bits_per_key);
+    }
+    options.compression = settings.compression;
+    options.max_file_size = settings.max_file_size;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -114,15 +175,15 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
-    : m_name(fs::basename(path))
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, DBProfile profile)
+    : m_name(fs::basename(path)), m_path(path.string()), m_cache_size(nCacheSize), m_profile(profile)
 {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, profile);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -139,6 +200,7 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    LogPrint(BCLog::LEVELDB, "LevelDB using profile %s for %s\n", DBProfileName(profile), path.string());
 
     if (gArgs.GetBoolArg("-forcecompactdb", false)) {
         LogPrintf("Starting database compaction of %s\n", path.string());
@@ -164,10 +226,17 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     }
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), HexStr(obfuscate_key));
+
+    LOCK(g_open_dbs_mutex);
+    g_open_dbs.insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        LOCK(g_open_dbs_mutex);
+        g_open_dbs.erase(this);
+    }
     delete pdb;
     pdb = nullptr;
     delete options.filter_policy;
@@ -206,6 +275,32 @@ size_t CDBWrapper::DynamicMemoryUsage() const {
     return stoul(memory);
 }
 
+std::vector<DBStats> GetDBStats()
+{
+    std::vector<DBStats> result;
+    LOCK(g_open_dbs_mutex);
+    for (const CDBWrapper* db : g_open_dbs) {
+        const DBProfileSettings& settings = GetProfileSettings(db->m_profile);
+        DBStats stats;
+        stats.name = db->m_name;
+        stats.path = db->m_path;
+        stats.profile = settings.name;
+        stats.block_cache_size = db->m_cache_size * settings.block_cache_percent / 100;
+        stats.block_cache_usage = db->options.block_cache->TotalCharge();
+        stats.write_buffer_size = db->options.write_buffer_size;
+        stats.block_size = db->options.block_size;
+        stats.bloom_bits_per_key = settings.bloom_bits_per_key;
+        stats.compression = db->options.compression != leveldb::kNoCompression;
+        stats.max_file_size = db->options.max_file_size;
+        stats.memory_usage = db->DynamicMemoryUsage();
+        if (!db->pdb->GetProperty("leveldb.stats", &stats.leveldb_stats)) {
+            LogPrint(BCLog::LEVELDB, "Failed to get stats property of %s\n", db->m_name);
+        }
+        result.push_back(std::move(stats));
+    }
+    return result;
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
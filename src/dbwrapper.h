@@ -27,6 +27,42 @@ public:
 
 class CDBWrapper;
 
+/**
+ * The access pattern a database is tuned for. Each profile has its own share
+ * of the cache for the write buffers, block size, bloom filter, compression
+ * and table file size, see GetOptions() in dbwrapper.cpp.
+ */
+enum class DBProfile {
+    DEFAULT,    //!< The settings used for every database before profiles existed
+    CHAINSTATE, //!< Random point reads of coins, written in large batches on flush
+    BLOCK_TREE, //!< A small hot set, read in full at startup
+    INDEX,      //!< Appends in block order with occasional point lookups
+};
+
+/** Name of a profile, as shown by getdbstats. */
+std::string DBProfileName(DBProfile profile);
+
+/** Statistics of an open database, see GetDBStats(). */
+struct DBStats {
+    std::string name;
+    std::string path;
+    std::string profile;
+    size_t block_cache_size;
+    size_t block_cache_usage;
+    size_t write_buffer_size;
+    size_t block_size;
+    int bloom_bits_per_key;
+    bool compression;
+    size_t max_file_size;
+    //! LevelDB's own estimate of its memory usage, in bytes
+    size_t memory_usage;
+    //! The leveldb.stats property: files, size and compaction work per level
+    std::string leveldb_stats;
+};
+
+/** Collect the statistics of all open databases. */
+std::vector<DBStats> GetDBStats();
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -201,6 +237,15 @@ private:
     //! the name of this database
     std::string m_name;
 
+    //! the location of this database
+    std::string m_path;
+
+    //! the cache size the options were derived from
+    size_t m_cache_size;
+
+    //! the access pattern the options were chosen for
+    DBProfile m_profile;
+
     //! a key used for optional XOR-obfuscation of the database
     std::vector<unsigned char> obfuscate_key;
 
@@ -212,6 +257,8 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
+    friend std::vector<DBStats> GetDBStats();
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -220,8 +267,9 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] profile     Access pattern to tune the leveldb options for.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, DBProfile profile = DBProfile::DEFAULT);
     ~CDBWrapper();
 
     CDBWrapper(const CDBWrapper&) = delete;
@@ -0,0 +1,242 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <coins.h>
+#include <index/coinstatsindex.h>
+#include <node/coinstats.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+constexpr char DB_BLOCK_HEIGHT = 't';
+constexpr char DB_MUHASH = 'M';
+
+std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+namespace {
+
+/** Statistics on the UTXO set as of a block, stored by height with the block hash. */
+struct DBVal {
+    uint256 muhash;
+    uint64_t transaction_output_count;
+    uint64_t bogo_size;
+    CAmount total_amount;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(muhash);
+        READWRITE(transaction_output_count);
+        READWRITE(bogo_size);
+        READWRITE(total_amount);
+    }
+};
+
+bool LookUpOne(const CDBWrapper& db, const CBlockIndex* block_index, DBVal& result)
+{
+    std::pair<uint256, DBVal> read_out;
+    if (!db.Read(std::make_pair(DB_BLOCK_HEIGHT, block_index->nHeight), read_out)) {
+        return false;
+    }
+    // An entry for this height written for a block that has since been
+    // reorganized away.
+    if (read_out.first != block_index->GetBlockHash()) {
+        return false;
+    }
+    result = read_out.second;
+    return true;
+}
+
+} // namespace
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<BaseIndex::DB>(GetDataDir() / "indexes" / "coinstats", n_cache_size, f_memory, f_wipe))
+{}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block outputs are not in the UTXO set.
+    if (pindex->nHeight > 0) {
+        DBVal prev;
+        if (!LookUpOne(*m_db, pindex->pprev, prev)) {
+            return error("%s: no entry for the previous block %s", __func__, pindex->pprev->GetBlockHash().ToString());
+        }
+
+        CBlockUndo block_undo;
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return false;
+        }
+
+        for (size_t i = 0; i < block.vtx.size(); ++i) {
+            const CTransactionRef& tx = block.vtx[i];
+
+            for (uint32_t j = 0; j < tx->vout.size(); ++j) {
+                const CTxOut& out = tx->vout[j];
+                // Unspendable outputs are never added to the coins database.
+                if (out.scriptPubKey.IsUnspendable()) continue;
+
+                ApplyCoinHash(m_muhash, COutPoint(tx->GetHash(), j), Coin(out, pindex->nHeight, tx->IsCoinBase()));
+                ++m_transaction_output_count;
+                m_total_amount += out.nValue;
+                m_bogo_size += GetBogoSize(out.scriptPubKey);
+            }
+
+            if (tx->IsCoinBase()) continue;
+            const CTxUndo& tx_undo = block_undo.vtxundo.at(i - 1);
+            for (size_t j = 0; j < tx->vin.size(); ++j) {
+                const Coin& coin = tx_undo.vprevout.at(j);
+                RemoveCoinHash(m_muhash, tx->vin[j].prevout, coin);
+                --m_transaction_output_count;
+                m_total_amount -= coin.out.nValue;
+                m_bogo_size -= GetBogoSize(coin.out.scriptPubKey);
+            }
+        }
+    }
+
+    DBVal value;
+    m_muhash.Finalize(value.muhash);
+    value.transaction_output_count = m_transaction_output_count;
+    value.bogo_size = m_bogo_size;
+    value.total_amount = m_total_amount;
+    return m_db->Write(std::make_pair(DB_BLOCK_HEIGHT, pindex->nHeight), std::make_pair(pindex->GetBlockHash(), value));
+}
+
+bool CoinStatsIndex::ReverseBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransactionRef& tx = block.vtx[i];
+
+        for (uint32_t j = 0; j < tx->vout.size(); ++j) {
+            const CTxOut& out = tx->vout[j];
+            if (out.scriptPubKey.IsUnspendable()) continue;
+
+            RemoveCoinHash(m_muhash, COutPoint(tx->GetHash(), j), Coin(out, pindex->nHeight, tx->IsCoinBase()));
+            --m_transaction_output_count;
+            m_total_amount -= out.nValue;
+            m_bogo_size -= GetBogoSize(out.scriptPubKey);
+        }
+
+        if (tx->IsCoinBase()) continue;
+        const CTxUndo& tx_undo = block_undo.vtxundo.at(i - 1);
+        for (size_t j = 0; j < tx->vin.size(); ++j) {
+            const Coin& coin = tx_undo.vprevout.at(j);
+            ApplyCoinHash(m_muhash, tx->vin[j].prevout, coin);
+            ++m_transaction_output_count;
+            m_total_amount += coin.out.nValue;
+            m_bogo_size += GetBogoSize(coin.out.scriptPubKey);
+        }
+    }
+
+    // The result has to match what was stored for the parent.
+    DBVal prev;
+    if (!LookUpOne(*m_db, pindex->pprev, prev)) {
+        return error("%s: no entry for the previous block %s", __func__, pindex->pprev->GetBlockHash().ToString());
+    }
+    uint256 out;
+    m_muhash.Finalize(out);
+    if (out != prev.muhash || m_transaction_output_count != prev.transaction_output_count ||
+        m_bogo_size != prev.bogo_size || m_total_amount != prev.total_amount) {
+        return error("%s: reverting block %s does not give the stored state of its parent", __func__, pindex->GetBlockHash().ToString());
+    }
+    return true;
+}
+
+bool CoinStatsIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    const CBlockIndex* iter_tip = current_tip;
+    while (iter_tip != new_tip) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, iter_tip, Params().GetConsensus())) {
+            return error("%s: Failed to read block %s from disk", __func__, iter_tip->GetBlockHash().ToString());
+        }
+        if (!ReverseBlock(block, iter_tip)) {
+            return false;
+        }
+        iter_tip = iter_tip->pprev;
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool CoinStatsIndex::CustomCommit(CDBBatch& batch)
+{
+    // The running MuHash goes with the locator; the other totals can be read
+    // back from the entry of the best block.
+    batch.Write(DB_MUHASH, m_muhash);
+    return true;
+}
+
+void CoinStatsIndex::Reset()
+{
+    m_muhash = MuHash3072();
+    m_transaction_output_count = 0;
+    m_bogo_size = 0;
+    m_total_amount = 0;
+
+    CDBBatch batch(*m_db);
+    m_db->WriteBestBlock(batch, CBlockLocator());
+    batch.Write(DB_MUHASH, m_muhash);
+    m_db->WriteBatch(batch);
+}
+
+bool CoinStatsIndex::Init()
+{
+    if (!m_db->Read(DB_MUHASH, m_muhash)) {
+        // A missing key just means a new index; anything else is corruption
+        // or a disk failure that must not be built upon.
+        if (m_db->Exists(DB_MUHASH)) {
+            return error("%s: Cannot read current %s state; index may be corrupted", __func__, GetName());
+        }
+        m_muhash = MuHash3072();
+    }
+
+    if (!BaseIndex::Init()) {
+        return false;
+    }
+
+    const CBlockIndex* pindex = CurrentIndex();
+    if (pindex) {
+        DBVal entry;
+        uint256 out;
+        m_muhash.Finalize(out);
+        // The locator can point past the block the chain state was flushed
+        // at, after an unclean shutdown. The running state cannot be rewound
+        // from there, so start over.
+        if (!LookUpOne(*m_db, pindex, entry) || entry.muhash != out) {
+            LogPrintf("%s: state does not match best block %s, rebuilding the index\n",
+                      GetName(), pindex->GetBlockHash().ToString());
+            Reset();
+            return BaseIndex::Init();
+        }
+        m_transaction_output_count = entry.transaction_output_count;
+        m_bogo_size = entry.bogo_size;
+        m_total_amount = entry.total_amount;
+    }
+    return true;
+}
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex* block_index, CCoinsStats& coins_stats) const
+{
+    DBVal entry;
+    if (!LookUpOne(*m_db, block_index, entry)) {
+        return false;
+    }
+
+    coins_stats.nHeight = block_index->nHeight;
+    coins_stats.hashBlock = block_index->GetBlockHash();
+    coins_stats.hashSerialized = entry.muhash;
+    coins_stats.nTransactionOutputs = entry.transaction_output_count;
+    coins_stats.nBogoSize = entry.bogo_size;
+    coins_stats.nTotalAmount = entry.total_amount;
+    return true;
+}
@@ -26,7 +26,10 @@
 #include <validationinterface.h>
 
 #include <algorithm>
+#include <atomic>
 #include <queue>
+#include <system_error>
+#include <thread>
 #include <utility>
 
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
@@ -445,3 +448,109 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+namespace {
+/** Number of consecutive nonces hashed together by a nonce search worker */
+static const uint32_t NONCE_BATCH_SIZE = 8;
+/** Nonce searches are summed over windows of at least this many microseconds to get a hash rate */
+static const int64_t HASHRATE_WINDOW = 4 * 1000 * 1000;
+
+Mutex g_hashrate_mutex;
+int64_t g_window_hashes GUARDED_BY(g_hashrate_mutex) = 0;
+int64_t g_window_micros GUARDED_BY(g_hashrate_mutex) = 0;
+double g_hashes_per_sec GUARDED_BY(g_hashrate_mutex) = 0;
+} // namespace
+
+bool ScanNonces(CBlockHeader& block, uint32_t nNonceEnd, int nThreads, uint64_t& nMaxTries, const Consensus::Params& params)
+{
+    // -genproclimit is not checked against the number of cores
+    if (nThreads < 1 || nThreads > GetNumCores()) nThreads = GetNumCores();
+    const unsigned int profile = GetPoWProfile(block, params);
+    const int64_t nStart = GetTimeMicros();
+
+    std::atomic<uint64_t> next{block.nNonce};
+    std::atomic<uint64_t> tries{nMaxTries};
+    std::atomic<uint64_t> hashes{0};
+    std::atomic<bool> found{false};
+    Mutex found_mutex;
+    uint32_t found_nonce = 0;
+
+    auto worker = [&]() {
+        std::vector<CBlockHeader> headers(NONCE_BATCH_SIZE, block);
+        std::vector<uint256> pow_hashes(NONCE_BATCH_SIZE);
+        while (!found) {
+            const uint64_t start = next.fetch_add(NONCE_BATCH_SIZE);
+            if (start >= nNonceEnd) break;
+            uint64_t count = std::min<uint64_t>(NONCE_BATCH_SIZE, nNonceEnd - start);
+            uint64_t left = tries.load();
+            do {
+                if (left == 0) return;
+            } while (!tries.compare_exchange_weak(left, left - std::min(left, count)));
+            count = std::min(left, count);
+
+            for (uint64_t i = 0; i < count; i++) {
+                headers[i].nNonce = start + i;
+            }
+            CBlockHeader::GetPoWHashes(headers.data(), count, profile, pow_hashes.data());
+            hashes += count;
+            for (uint64_t i = 0; i < count; i++) {
+                if (CheckProofOfWork(pow_hashes[i], block.nBits, params)) {
+                    LOCK(found_mutex);
+                    if (!found || headers[i].nNonce < found_nonce) found_nonce = headers[i].nNonce;
+                    found = true;
+                    break;
+                }
+            }
+        }
+    };
+
+    if (nThreads == 1) {
+        worker();
+    } else {
+        std::vector<std::thread> threads;
+        try {
+            for (int i = 0; i < nThreads; i++) {
+                threads.emplace_back(worker);
+            }
+        } catch (const std::system_error& e) {
+            // Search with the threads that could be started
+            LogPrintf("%s: started %u of %d threads: %s\n", __func__, threads.size(), nThreads, e.what());
+        }
+        if (threads.empty()) {
+            worker();
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    nMaxTries = tries;
+    {
+        LOCK(g_hashrate_mutex);
+        g_window_hashes += hashes;
+        g_window_micros += GetTimeMicros() - nStart;
+        if (g_window_micros >= HASHRATE_WINDOW) {
+            g_hashes_per_sec = g_window_hashes * 1000000.0 / g_window_micros;
+            g_window_hashes = 0;
+            g_window_micros = 0;
+        }
+    }
+
+    LOCK(found_mutex);
+    if (found) {
+        block.nNonce = found_nonce;
+        return true;
+    }
+    block.nNonce = std::min<uint64_t>(next, nNonceEnd);
+    return false;
+}
+
+double GetMinerHashesPerSec()
+{
+    LOCK(g_hashrate_mutex);
+    // Until a full window has passed, report what we have
+    if (g_hashes_per_sec == 0 && g_window_micros > 0) {
+        return g_window_hashes * 1000000.0 / g_window_micros;
+    }
+    return g_hashes_per_sec;
+}
@@ -202,4 +202,17 @@ private:
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
+/**
+ * Search the nonces from block.nNonce up to nNonceEnd for a valid proof of
+ * work. The nonce space is shared by nThreads workers (all cores if < 1),
+ * each hashing batches of consecutive nonces with the multi-lane NeoScrypt
+ * engines. nMaxTries is reduced by the number of nonces tried. Returns true
+ * and sets block.nNonce to the lowest valid nonce found, or returns false
+ * with block.nNonce past the last nonce tried.
+ */
+bool ScanNonces(CBlockHeader& block, uint32_t nNonceEnd, int nThreads, uint64_t& nMaxTries, const Consensus::Params& params);
+
+/** Hash rate of the internal miner over its recent nonce searches */
+double GetMinerHashesPerSec();
+
 #endif // BITCOIN_MINER_H
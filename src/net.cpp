@@ -31,6 +31,10 @@
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -58,6 +62,11 @@ static constexpr int DUMP_PEERS_INTERVAL = 15 * 60;
 #define MSG_DONTWAIT 0
 #endif
 
+#ifndef WIN32
+/** Maximum number of queued send buffers gathered into one sendmsg() call */
+static const int MAX_SEND_IOV = 64;
+#endif
+
 /** Used to pass flags to the Bind() function */
 enum BindFlags {
     BF_NONE         = 0,
@@ -70,6 +79,11 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+// Events taken from an epoll instance at once
+static const int MAX_EPOLL_EVENTS = 256;
+// Reads from one socket before the other sockets of its thread get a turn
+static const int MAX_SOCKET_READS_PER_ROUND = 8;
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -668,12 +682,16 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+    if (vRecv.capacity() < nDataPos + nCopy) {
+        // Allocate up to 256 KiB ahead, or twice what we have as resize() would,
+        // but never more than the total message size.
+        vRecv.reserve(std::min<size_t>(hdr.nMessageSize, std::max<size_t>(2 * vRecv.capacity(), nDataPos + nCopy + 256 * 1024)));
     }
 
     hasher.Write((const unsigned char*)pch, nCopy);
+    // Only zero-fill the range about to be overwritten. CDataStream::write()
+    // would append byte by byte through zero_after_free_allocator.
+    vRecv.resize(nDataPos + nCopy);
     memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
@@ -694,27 +712,56 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert((*it)->size() > pnode->nSendOffset);
+        size_t nGathered = 0;
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            const auto &data = **it;
+            nGathered = data.size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, nGathered, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Hand as many queued headers and payloads as possible to the
+            // kernel at once, instead of one send() per buffer
+            struct iovec iov[MAX_SEND_IOV];
+            int nIov = 0;
+            size_t nOffset = pnode->nSendOffset;
+            for (auto itGather = it; itGather != pnode->vSendMsg.end() && nIov < MAX_SEND_IOV; ++itGather, ++nIov) {
+                const auto &data = **itGather;
+                iov[nIov].iov_base = const_cast<unsigned char*>(data.data()) + nOffset;
+                iov[nIov].iov_len = data.size() - nOffset;
+                nGathered += iov[nIov].iov_len;
+                nOffset = 0;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Drop the buffers sent in full
+            size_t nAdvance = nBytes;
+            while (nAdvance > 0) {
+                const size_t nLeft = (*it)->size() - pnode->nSendOffset;
+                if (nAdvance < nLeft) {
+                    pnode->nSendOffset += nAdvance;
+                    break;
+                }
+                nAdvance -= nLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nGathered) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -968,6 +1015,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
+    AddSocketShardNode(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1247,6 +1295,63 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 }
 #endif
 
+int CConnman::SocketRecvData(CNode* pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = 0;
+    {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            return 0;
+        nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    }
+    if (nBytes > 0)
+    {
+        bool notify = false;
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+            pnode->CloseSocketDisconnect();
+        RecordBytesRecv(nBytes);
+        if (notify) {
+            size_t nSizeAdded = 0;
+            auto it(pnode->vRecvMsg.begin());
+            for (; it != pnode->vRecvMsg.end(); ++it) {
+                if (!it->complete())
+                    break;
+                nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+            }
+            {
+                LOCK(pnode->cs_vProcessMsg);
+                pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
+                pnode->nProcessQueueSize += nSizeAdded;
+                pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+            }
+            WakeMessageHandler();
+        }
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect) {
+            LogPrint(BCLog::NET, "socket closed\n");
+        }
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+            return 0;
+        }
+    }
+    return nBytes;
+}
+
 void CConnman::SocketHandler()
 {
     std::set<SOCKET> recv_set, send_set, error_set;
@@ -1296,57 +1401,7 @@ void CConnman::SocketHandler()
         }
         if (recvSet || errorSet)
         {
-            // typical socket buffer is 8K-64K
-            char pchBuf[0x10000];
-            int nBytes = 0;
-            {
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-            }
-            if (nBytes > 0)
-            {
-                bool notify = false;
-                if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-                    pnode->CloseSocketDisconnect();
-                RecordBytesRecv(nBytes);
-                if (notify) {
-                    size_t nSizeAdded = 0;
-                    auto it(pnode->vRecvMsg.begin());
-                    for (; it != pnode->vRecvMsg.end(); ++it) {
-                        if (!it->complete())
-                            break;
-                        nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
-                    }
-                    {
-                        LOCK(pnode->cs_vProcessMsg);
-                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                        pnode->nProcessQueueSize += nSizeAdded;
-                        pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                    }
-                    WakeMessageHandler();
-                }
-            }
-            else if (nBytes == 0)
-            {
-                // socket closed gracefully
-                if (!pnode->fDisconnect) {
-                    LogPrint(BCLog::NET, "socket closed\n");
-                }
-                pnode->CloseSocketDisconnect();
-            }
-            else if (nBytes < 0)
-            {
-                // error
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                {
-                    if (!pnode->fDisconnect)
-                        LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                    pnode->CloseSocketDisconnect();
-                }
-            }
+            SocketRecvData(pnode);
         }
 
         //
@@ -1376,17 +1431,223 @@ void CConnman::ThreadSocketHandler()
     {
         DisconnectNodes();
         NotifyNumConnectionsChanged();
-        SocketHandler();
+        if (!m_socket_shards.empty()) {
+            ShardSocketHandler(*m_socket_shards[0], true);
+        } else {
+            SocketHandler();
+        }
+    }
+}
+
+#ifdef USE_EPOLL
+/**
+ * Sockets stay registered with the epoll instance from connection to
+ * disconnection, edge-triggered for both reading and writing, instead of
+ * being collected again for every poll() call. Edge-triggered events are
+ * only reported once, so a node whose data was not read to the end (because
+ * it is paused, or had its turn) is remembered in fRecvPending.
+ *
+ * Each registered node holds a reference, so that the event data can point
+ * at it; the shard drops it once the node is disconnected.
+ */
+struct CConnman::SocketShard
+{
+    int epoll_fd{-1};
+    Mutex cs_nodes_new;
+    //! Nodes registered by other threads, not yet in vNodes
+    std::vector<CNode*> vNodesNew GUARDED_BY(cs_nodes_new);
+    //! Used only by the thread servicing this shard
+    std::vector<CNode*> vNodes;
+};
+
+void CConnman::StartSocketShards()
+{
+    for (int i = 0; i < m_net_threads; i++) {
+        std::unique_ptr<SocketShard> shard = MakeUnique<SocketShard>();
+        shard->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (shard->epoll_fd < 0) {
+            LogPrintf("epoll_create1 failed: %s, using poll\n", NetworkErrorString(WSAGetLastError()));
+            StopSocketShards();
+            return;
+        }
+        m_socket_shards.push_back(std::move(shard));
+    }
+
+    // Listening sockets are level-triggered and accepted from one at a time,
+    // as with poll().
+    for (ListenSocket& hListenSocket : vhListenSocket) {
+        struct epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = &hListenSocket;
+        if (epoll_ctl(m_socket_shards[0]->epoll_fd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+            LogPrintf("epoll_ctl failed for a listening socket: %s, using poll\n", NetworkErrorString(WSAGetLastError()));
+            StopSocketShards();
+            return;
+        }
+    }
+
+    for (size_t i = 1; i < m_socket_shards.size(); i++) {
+        m_socket_shard_threads.emplace_back(&CConnman::ThreadSocketShard, this, i);
+    }
+    LogPrintf("Using epoll with %u socket thread(s)\n", m_socket_shards.size());
+}
+
+void CConnman::StopSocketShards()
+{
+    for (std::thread& thread : m_socket_shard_threads)
+        thread.join();
+    m_socket_shard_threads.clear();
+
+    for (const std::unique_ptr<SocketShard>& shard : m_socket_shards) {
+        {
+            LOCK(shard->cs_nodes_new);
+            shard->vNodes.insert(shard->vNodes.end(), shard->vNodesNew.begin(), shard->vNodesNew.end());
+            shard->vNodesNew.clear();
+        }
+        for (CNode* pnode : shard->vNodes)
+            pnode->Release();
+        close(shard->epoll_fd);
+    }
+    m_socket_shards.clear();
+}
+
+void CConnman::AddSocketShardNode(CNode* pnode)
+{
+    if (m_socket_shards.empty())
+        return;
+    SocketShard& shard = *m_socket_shards[pnode->GetId() % m_socket_shards.size()];
+    pnode->AddRef();
+    {
+        LOCK(shard.cs_nodes_new);
+        shard.vNodesNew.push_back(pnode);
+    }
+
+    struct epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET)
+        return;
+    if (epoll_ctl(shard.epoll_fd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+    }
+}
+
+void CConnman::ShardSocketHandler(SocketShard& shard, bool fAccept)
+{
+    {
+        LOCK(shard.cs_nodes_new);
+        shard.vNodes.insert(shard.vNodes.end(), shard.vNodesNew.begin(), shard.vNodesNew.end());
+        shard.vNodesNew.clear();
     }
+
+    // Let go of disconnected nodes, and see whether any have data left to read
+    bool fRecvPending = false;
+    for (auto it = shard.vNodes.begin(); it != shard.vNodes.end();) {
+        CNode* pnode = *it;
+        if (pnode->fDisconnect) {
+            {
+                LOCK(pnode->cs_hSocket);
+                if (pnode->hSocket != INVALID_SOCKET)
+                    epoll_ctl(shard.epoll_fd, EPOLL_CTL_DEL, pnode->hSocket, nullptr);
+            }
+            pnode->Release();
+            it = shard.vNodes.erase(it);
+            continue;
+        }
+        fRecvPending |= pnode->fRecvPending && !pnode->fPauseRecv;
+        ++it;
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(shard.epoll_fd, events, MAX_EPOLL_EVENTS, fRecvPending ? 0 : SELECT_TIMEOUT_MILLISECONDS);
+    if (interruptNet) return;
+    if (nEvents < 0) {
+        if (errno != EINTR) {
+            LogPrintf("epoll_wait error %s\n", NetworkErrorString(WSAGetLastError()));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        if (fAccept) {
+            const ListenSocket* pListenSocket = nullptr;
+            for (const ListenSocket& hListenSocket : vhListenSocket) {
+                if (events[i].data.ptr == &hListenSocket)
+                    pListenSocket = &hListenSocket;
+            }
+            if (pListenSocket) {
+                AcceptConnection(*pListenSocket);
+                continue;
+            }
+        }
+
+        CNode* pnode = static_cast<CNode*>(events[i].data.ptr);
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            pnode->fRecvPending = true;
+        if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+            LOCK(pnode->cs_vSend);
+            size_t nBytes = SocketSendData(pnode);
+            if (nBytes) {
+                RecordBytesSent(nBytes);
+            }
+        }
+    }
+
+    // Read until the socket would block, unless the message handler is behind
+    // or the node had enough turns for this round. A node that stops early
+    // keeps fRecvPending and is read from again in a later round.
+    for (CNode* pnode : shard.vNodes) {
+        if (interruptNet)
+            return;
+        for (int nReads = 0; pnode->fRecvPending && !pnode->fPauseRecv && nReads < MAX_SOCKET_READS_PER_ROUND; nReads++) {
+            int nBytes = SocketRecvData(pnode);
+            // Only a read that would block means the data epoll reported is
+            // used up; after EINTR and the like it may still be there.
+            if (nBytes == 0 || (nBytes < 0 && WSAGetLastError() == WSAEWOULDBLOCK))
+                pnode->fRecvPending = false;
+        }
+        InactivityCheck(pnode);
+    }
+}
+
+void CConnman::ThreadSocketShard(size_t nShard)
+{
+    const std::string name = strprintf("net.%u", nShard);
+    TraceThread(name.c_str(), [this, nShard] {
+        while (!interruptNet)
+        {
+            ShardSocketHandler(*m_socket_shards[nShard], false);
+        }
+    });
 }
+#else
+// Without epoll there are no shards and m_socket_shards stays empty
+struct CConnman::SocketShard {};
+
+void CConnman::StartSocketShards() {}
+void CConnman::StopSocketShards() {}
+void CConnman::AddSocketShardNode(CNode* pnode) {}
+void CConnman::ShardSocketHandler(SocketShard& shard, bool fAccept) {}
+void CConnman::ThreadSocketShard(size_t nShard) {}
+#endif
 
 void CConnman::WakeMessageHandler()
 {
+    size_t nThreads;
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        nThreads = vMsgProcWake.size();
+        vMsgProcWake.assign(nThreads, true);
+    }
+    // Any of the threads may be the one to get to the peer with new work
+    if (nThreads > 1) {
+        condMsgProc.notify_all();
+    } else {
+        condMsgProc.notify_one();
     }
-    condMsgProc.notify_one();
 }
 
 
@@ -1938,13 +2199,14 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         pnode->m_manual_connection = true;
 
     m_msgproc->InitializeNode(pnode);
+    AddSocketShardNode(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(size_t nWorker)
 {
     while (!flagInterruptMsgProc)
     {
@@ -1964,16 +2226,22 @@ void CConnman::ThreadMessageHandler()
             if (pnode->fDisconnect)
                 continue;
 
+            // Skip peers another message handler thread is working on; their
+            // messages are processed one at a time and in order.
+            bool fProcessing = false;
+            if (!pnode->fProcessingMsgs.compare_exchange_strong(fProcessing, true))
+                continue;
+
             // Receive messages
             bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
             fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
-            if (flagInterruptMsgProc)
-                return;
-            // Send messages
+            if (!flagInterruptMsgProc)
             {
+                // Send messages
                 LOCK(pnode->cs_sendProcessing);
                 m_msgproc->SendMessages(pnode);
             }
+            pnode->fProcessingMsgs = false;
 
             if (flagInterruptMsgProc)
                 return;
@@ -1987,12 +2255,29 @@ void CConnman::ThreadMessageHandler()
 
         WAIT_LOCK(mutexMsgProc, lock);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this, nWorker] { return vMsgProcWake[nWorker]; });
         }
-        fMsgProcWake = false;
+        vMsgProcWake[nWorker] = false;
     }
 }
 
+void CConnman::StartMessageHandlers()
+{
+    {
+        LOCK(mutexMsgProc);
+        vMsgProcWake.assign(m_msghand_threads, false);
+    }
+    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, 0)));
+    for (int i = 1; i < m_msghand_threads; i++)
+        m_msghand_worker_threads.emplace_back(&CConnman::ThreadMessageHandlerWorker, this, i);
+}
+
+void CConnman::ThreadMessageHandlerWorker(size_t nWorker)
+{
+    const std::string name = strprintf("msghand.%u", nWorker);
+    TraceThread(name.c_str(), std::bind(&CConnman::ThreadMessageHandler, this, nWorker));
+}
+
 
 
 
@@ -2241,12 +2526,8 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
-    {
-        LOCK(mutexMsgProc);
-        fMsgProcWake = false;
-    }
-
     // Send and receive from sockets, accept connections
+    StartSocketShards();
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
     if (!gArgs.GetBoolArg("-dnsseed", true))
@@ -2269,7 +2550,7 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    StartMessageHandlers();
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpAddresses, this), DUMP_PEERS_INTERVAL * 1000);
@@ -2320,6 +2601,9 @@ void CConnman::Stop()
 {
     if (threadMessageHandler.joinable())
         threadMessageHandler.join();
+    for (std::thread& thread : m_msghand_worker_threads)
+        thread.join();
+    m_msghand_worker_threads.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2328,6 +2612,7 @@ void CConnman::Stop()
         threadDNSAddressSeed.join();
     if (threadSocketHandler.joinable())
         threadSocketHandler.join();
+    StopSocketShards();
 
     if (fAddressesInitialized)
     {
@@ -2602,6 +2887,11 @@ ServiceFlags CConnman::GetLocalServices() const
     return nLocalServices;
 }
 
+void CConnman::RemoveLocalServices(ServiceFlags services)
+{
+    nLocalServices = ServiceFlags(nLocalServices & ~services);
+}
+
 void CConnman::SetBestHeight(int height)
 {
     nBestHeight.store(height, std::memory_order_release);
@@ -2689,20 +2979,31 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
-void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+CSharedNetMsg::CSharedNetMsg(CSerializedNetMsg&& msg) : command(std::move(msg.command))
 {
-    size_t nMessageSize = msg.data.size();
-    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
-    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
-
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
-    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
+    uint256 hash = Hash(msg.data.data(), msg.data.data() + msg.data.size());
+    CMessageHeader hdr(Params().MessageStart(), command.c_str(), msg.data.size());
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
+    header = std::make_shared<const std::vector<unsigned char>>(std::move(serializedHeader));
+    data = std::make_shared<const std::vector<unsigned char>>(std::move(msg.data));
+}
+
+void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+{
+    PushMessage(pnode, CSharedNetMsg(std::move(msg)));
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    size_t nMessageSize = msg.data->size();
+    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
+    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
+
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
@@ -2714,9 +3015,9 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.push_back(msg.header);
         if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(msg.data);
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
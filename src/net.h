@@ -85,6 +85,14 @@ static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** -netthreads default: threads servicing peer sockets (only with epoll) */
+static const int DEFAULT_NET_THREADS = 1;
+/** Maximum number of threads servicing peer sockets */
+static const int MAX_NET_THREADS = 16;
+/** -msghandthreads default: threads processing peer messages */
+static const int DEFAULT_MSGHAND_THREADS = 1;
+/** Maximum number of threads processing peer messages */
+static const int MAX_MSGHAND_THREADS = 16;
 
 typedef int64_t NodeId;
 
@@ -112,6 +120,20 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/**
+ * A message with its header serialized and its payload moved into a
+ * reference-counted buffer. Both buffers are shared by the send queues of all
+ * peers the message is pushed to, so it is serialized and checksummed once.
+ */
+struct CSharedNetMsg
+{
+    explicit CSharedNetMsg(CSerializedNetMsg&& msg);
+
+    std::shared_ptr<const std::vector<unsigned char>> header;
+    std::shared_ptr<const std::vector<unsigned char>> data;
+    std::string command;
+};
+
 
 class NetEventsInterface;
 class CConnman
@@ -141,6 +163,8 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
+        int m_net_threads = DEFAULT_NET_THREADS;
+        int m_msghand_threads = DEFAULT_MSGHAND_THREADS;
         std::vector<std::string> vSeedNodes;
         std::vector<CSubNet> vWhitelistedRange;
         std::vector<CService> vBinds, vWhiteBinds;
@@ -163,6 +187,8 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        m_net_threads = std::max(1, std::min(connOptions.m_net_threads, MAX_NET_THREADS));
+        m_msghand_threads = std::max(1, std::min(connOptions.m_msghand_threads, MAX_MSGHAND_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -200,6 +226,7 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
 
     template<typename Callable>
     void ForEachNode(Callable&& func)
@@ -275,6 +302,8 @@ public:
     bool DisconnectNode(NodeId id);
 
     ServiceFlags GetLocalServices() const;
+    //! Stop offering services to the peers connected from now on
+    void RemoveLocalServices(ServiceFlags services);
 
     //!set the max outbound target in bytes
     void SetMaxOutboundTarget(uint64_t limit);
@@ -324,6 +353,9 @@ private:
         ListenSocket(SOCKET socket_, bool whitelisted_) : socket(socket_), whitelisted(whitelisted_) {}
     };
 
+    /** An epoll instance and the nodes whose sockets are registered with it, serviced by one thread */
+    struct SocketShard;
+
     bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhitelisted = false);
     bool Bind(const CService &addr, unsigned int flags);
     bool InitBinds(const std::vector<CService>& binds, const std::vector<CService>& whiteBinds);
@@ -331,7 +363,9 @@ private:
     void AddOneShot(const std::string& strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void StartMessageHandlers();
+    void ThreadMessageHandler(size_t nWorker);
+    void ThreadMessageHandlerWorker(size_t nWorker);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
@@ -340,6 +374,13 @@ private:
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketHandler();
     void ThreadSocketHandler();
+    /** Read once from the node's socket. Returns the bytes read, 0 if the socket is closed, or <0 if nothing could be read now, with WSAGetLastError() telling why. */
+    int SocketRecvData(CNode* pnode);
+    void StartSocketShards();
+    void StopSocketShards();
+    void AddSocketShardNode(CNode* pnode);
+    void ShardSocketHandler(SocketShard& shard, bool fAccept);
+    void ThreadSocketShard(size_t nShard);
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress& ad) const;
@@ -382,6 +423,12 @@ private:
     // P2P timeout in seconds
     int64_t m_peer_connect_timeout;
 
+    // Threads servicing peer sockets; more than one only with epoll
+    int m_net_threads{DEFAULT_NET_THREADS};
+
+    // Threads processing peer messages, each working on one peer at a time
+    int m_msghand_threads{DEFAULT_MSGHAND_THREADS};
+
     // Whitelisted ranges. Any node connecting from these is automatically
     // whitelisted (as well as those connecting to whitelisted binds).
     std::vector<CSubNet> vWhitelistedRange;
@@ -404,7 +451,7 @@ private:
     unsigned int nPrevNodeCount{0};
 
     /** Services this instance offers */
-    ServiceFlags nLocalServices;
+    std::atomic<ServiceFlags> nLocalServices;
 
     std::unique_ptr<CSemaphore> semOutbound;
     std::unique_ptr<CSemaphore> semAddnode;
@@ -421,8 +468,8 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** flags for waking the message processors, one per message handler thread */
+    std::vector<bool> vMsgProcWake;
 
     std::condition_variable condMsgProc;
     Mutex mutexMsgProc;
@@ -432,9 +479,15 @@ private:
 
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
+    //! Empty unless epoll is used. Shard 0 is serviced by threadSocketHandler,
+    //! the others by m_socket_shard_threads.
+    std::vector<std::unique_ptr<SocketShard>> m_socket_shards;
+    std::vector<std::thread> m_socket_shard_threads;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadMessageHandler;
+    //! The message handler threads besides threadMessageHandler
+    std::vector<std::thread> m_msghand_worker_threads;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
@@ -632,7 +685,7 @@ public:
     size_t nSendSize{0}; // total size of all vSendMsg entries
     size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<std::shared_ptr<const std::vector<unsigned char>>> vSendMsg GUARDED_BY(cs_vSend);
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -686,6 +739,9 @@ public:
     std::atomic<int> nRefCount{0};
 
     const uint64_t nKeyedNetGroup;
+    // Set by the message handler thread working on this peer, so that no
+    // other one processes its messages at the same time
+    std::atomic_bool fProcessingMsgs{false};
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
 
@@ -698,8 +754,10 @@ public:
     std::atomic<int> nStartingHeight{-1};
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    CRollingBloomFilter addrKnown;
+    // Other peers' message handler threads push addresses to relay to this one
+    CCriticalSection cs_addrSend;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(cs_addrSend);
+    CRollingBloomFilter addrKnown GUARDED_BY(cs_addrSend);
     bool fGetAddr{false};
     std::set<uint256> setKnown;
     int64_t nNextAddrSend GUARDED_BY(cs_sendProcessing){0};
@@ -764,6 +822,7 @@ private:
     const int nMyStartingHeight;
     int nSendVersion{0};
     std::list<CNetMessage> vRecvMsg;  // Used only by SocketHandler thread
+    bool fRecvPending{false}; // Used only by SocketHandler thread: epoll reported data that is still unread
 
     mutable CCriticalSection cs_addrName;
     std::string addrName GUARDED_BY(cs_addrName);
@@ -823,11 +882,13 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_addrSend);
         addrKnown.insert(_addr.GetKey());
     }
 
     void PushAddress(const CAddress& _addr, FastRandomContext &insecure_rand)
     {
+        LOCK(cs_addrSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
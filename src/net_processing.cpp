@@ -76,6 +76,14 @@ struct COrphanTx {
 CCriticalSection g_cs_orphans;
 std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
 
+/**
+ * Held by a message handler thread while it processes any message not listed
+ * in IsParallelMessage(), and while it runs SendMessages(), so that with
+ * -msghandthreads > 1 messages that change chain, mempool or peer sync state
+ * are still processed one at a time. Acquired before cs_main.
+ */
+CCriticalSection g_cs_serial_msgproc;
+
 void EraseOrphansFor(NodeId peer);
 
 /** Increase a node's misbehavior score. */
@@ -571,7 +579,8 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
                 return;
             }
             if (pindex->nStatus & BLOCK_HAVE_DATA || chainActive.Contains(pindex)) {
-                if (pindex->HaveTxsDownloaded())
+                // Blocks below a UTXO set snapshot are in our chain without having been downloaded
+                if (pindex->HaveTxsDownloaded() || chainActive.Contains(pindex))
                     state->pindexLastCommonBlock = pindex;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
@@ -913,6 +922,70 @@ static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_bloc
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
 static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block);
 
+/**
+ * Messages carrying the most recent block, each serialized the first time a
+ * peer needs it and then pushed to every other peer as the same buffers.
+ */
+struct RecentBlockMessages
+{
+    //! block and cmpctblock messages, indexed by whether they include witnesses
+    std::shared_ptr<const CSharedNetMsg> block[2];
+    std::shared_ptr<const CSharedNetMsg> cmpctblock[2];
+    //! headers announcements ending with the block, by their number of headers
+    std::map<size_t, std::shared_ptr<const CSharedNetMsg>> headers;
+};
+static RecentBlockMessages most_recent_block_msgs GUARDED_BY(cs_most_recent_block);
+
+/** The block message for hash if it is the most recent block, else nullptr */
+static std::shared_ptr<const CSharedNetMsg> GetRecentBlockMsg(const uint256& hash, bool fWitness)
+{
+    LOCK(cs_most_recent_block);
+    if (!most_recent_block || most_recent_block_hash != hash)
+        return nullptr;
+    std::shared_ptr<const CSharedNetMsg>& msg = most_recent_block_msgs.block[fWitness];
+    if (!msg) {
+        const int nSendFlags = fWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+        msg = std::make_shared<const CSharedNetMsg>(CNetMsgMaker(PROTOCOL_VERSION).Make(nSendFlags, NetMsgType::BLOCK, *most_recent_block));
+    }
+    return msg;
+}
+
+/** The cmpctblock message for hash if it is the most recent block, else nullptr */
+static std::shared_ptr<const CSharedNetMsg> GetRecentCompactBlockMsg(const uint256& hash, bool fWitness)
+{
+    LOCK(cs_most_recent_block);
+    if (!most_recent_block || most_recent_block_hash != hash)
+        return nullptr;
+    std::shared_ptr<const CSharedNetMsg>& msg = most_recent_block_msgs.cmpctblock[fWitness];
+    if (!msg) {
+        const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+        const int nSendFlags = fWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+        if (fWitness || !fWitnessesPresentInMostRecentCompactBlock) {
+            msg = std::make_shared<const CSharedNetMsg>(msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
+        } else {
+            CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, false);
+            msg = std::make_shared<const CSharedNetMsg>(msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+        }
+    }
+    return msg;
+}
+
+/**
+ * The headers message for vHeaders, a chain of headers ending with hashLast,
+ * if that is the most recent block, else nullptr
+ */
+static std::shared_ptr<const CSharedNetMsg> GetRecentHeadersMsg(const std::vector<CBlock>& vHeaders, const uint256& hashLast)
+{
+    LOCK(cs_most_recent_block);
+    if (!most_recent_block || most_recent_block_hash != hashLast)
+        return nullptr;
+    std::shared_ptr<const CSharedNetMsg>& msg = most_recent_block_msgs.headers[vHeaders.size()];
+    if (!msg) {
+        msg = std::make_shared<const CSharedNetMsg>(CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::HEADERS, vHeaders));
+    }
+    return msg;
+}
+
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
  * to compatible peers.
@@ -920,6 +993,7 @@ static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    std::shared_ptr<const CSharedNetMsg> cmpctblock_msg = std::make_shared<const CSharedNetMsg>(msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
 
     LOCK(cs_main);
 
@@ -937,12 +1011,13 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
+        most_recent_block_msgs = RecentBlockMessages();
+        most_recent_block_msgs.cmpctblock[true] = cmpctblock_msg;
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
+    connman->ForEachNode([this, &cmpctblock_msg, pindex, fWitnessEnabled, &hashBlock](CNode* pnode) {
         AssertLockHeld(cs_main);
 
-        // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -954,7 +1029,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode, *cmpctblock_msg);
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1190,17 +1265,31 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
     // it's available before trying to send.
     if (send && (pindex->nStatus & BLOCK_HAVE_DATA))
     {
+        // The most recent block is served from messages serialized once for all peers
+        std::shared_ptr<const CSharedNetMsg> recent_msg;
+        if (inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK) {
+            recent_msg = GetRecentBlockMsg(pindex->GetBlockHash(), inv.type == MSG_WITNESS_BLOCK);
+        } else if (inv.type == MSG_CMPCT_BLOCK && CanDirectFetch(consensusParams) && pindex->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+            recent_msg = GetRecentCompactBlockMsg(pindex->GetBlockHash(), State(pfrom->GetId())->fWantsCmpctWitness);
+        }
         std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
+        if (recent_msg) {
+            connman->PushMessage(pfrom, *recent_msg);
+            // Don't set pblock as we've sent the block
+        } else if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
             pblock = a_recent_block;
-        } else if (inv.type == MSG_WITNESS_BLOCK) {
+        } else if (inv.type == MSG_WITNESS_BLOCK || inv.type == MSG_BLOCK) {
             // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
+            // as the network format matches the format on disk. Peers asking for
+            // MSG_BLOCK get a copy without the witness data. The bytes are read
+            // straight into the message, skipping deserialization, the proof of
+            // work check and serialization again.
+            CSerializedNetMsg msg;
+            msg.command = NetMsgType::BLOCK;
+            if (!ReadRawBlockFromDisk(msg.data, pindex, chainparams.MessageStart(), inv.type == MSG_WITNESS_BLOCK)) {
                 assert(!"cannot load block from disk");
             }
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
+            connman->PushMessage(pfrom, std::move(msg));
             // Don't set pblock as we've sent the block
         } else {
             // Send block from disk
@@ -2794,7 +2883,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addrSend);
+            pfrom->vAddrToSend.clear();
+        }
         std::vector<CAddress> vAddr = connman->GetAddresses();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr) {
@@ -3029,6 +3121,20 @@ bool PeerLogicValidation::SendRejectsAndCheckIfBanned(CNode* pnode, bool enable_
     return false;
 }
 
+/**
+ * Messages whose processing only reads shared state, or updates it under its
+ * own locks, and so may run on several message handler threads at once.
+ */
+static bool IsParallelMessage(const std::string& strCommand)
+{
+    return strCommand == NetMsgType::PING ||
+           strCommand == NetMsgType::ADDR ||
+           strCommand == NetMsgType::INV ||
+           strCommand == NetMsgType::GETHEADERS ||
+           strCommand == NetMsgType::GETDATA ||
+           strCommand == NetMsgType::GETBLOCKTXN;
+}
+
 bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     const CChainParams& chainparams = Params();
@@ -3047,6 +3153,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
 
     if (!pfrom->orphan_work_set.empty()) {
         std::list<CTransactionRef> removed_txn;
+        LOCK(g_cs_serial_msgproc);
         LOCK2(cs_main, g_cs_orphans);
         ProcessOrphanTx(connman, pfrom->orphan_work_set, removed_txn);
         for (const CTransactionRef& removedTx : removed_txn) {
@@ -3114,7 +3221,12 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     bool fRet = false;
     try
     {
-        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc, m_enable_bip61);
+        if (IsParallelMessage(strCommand)) {
+            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc, m_enable_bip61);
+        } else {
+            LOCK(g_cs_serial_msgproc);
+            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc, m_enable_bip61);
+        }
         if (interruptMsgProc)
             return false;
         if (!pfrom->vRecvGetData.empty())
@@ -3352,6 +3464,9 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             }
         }
 
+        TRY_LOCK(g_cs_serial_msgproc, lockSerial);
+        if (!lockSerial)
+            return true;
         TRY_LOCK(cs_main, lockMain); // Acquire cs_main for IsInitialBlockDownload() and CNodeState()
         if (!lockMain)
             return true;
@@ -3371,6 +3486,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_addrSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend)
@@ -3503,20 +3619,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
 
                     int nSendFlags = state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
 
-                    bool fGotBlockFromCache = false;
-                    {
-                        LOCK(cs_most_recent_block);
-                        if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
-                                connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
-                            else {
-                                CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
-                                connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                            }
-                            fGotBlockFromCache = true;
-                        }
-                    }
-                    if (!fGotBlockFromCache) {
+                    std::shared_ptr<const CSharedNetMsg> cmpctblock_msg = GetRecentCompactBlockMsg(pBestIndex->GetBlockHash(), state.fWantsCmpctWitness);
+                    if (cmpctblock_msg) {
+                        connman->PushMessage(pto, *cmpctblock_msg);
+                    } else {
                         CBlock block;
                         bool ret = ReadBlockFromDisk(block, pBestIndex, consensusParams);
                         assert(ret);
@@ -3534,7 +3640,12 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                         LogPrint(BCLog::NET, "%s: sending header %s to peer=%d\n", __func__,
                                 vHeaders.front().GetHash().ToString(), pto->GetId());
                     }
-                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                    std::shared_ptr<const CSharedNetMsg> headers_msg = GetRecentHeadersMsg(vHeaders, pBestIndex->GetBlockHash());
+                    if (headers_msg) {
+                        connman->PushMessage(pto, *headers_msg);
+                    } else {
+                        connman->PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                    }
                     state.pindexBestHeaderSent = pBestIndex;
                 } else
                     fRevertToInv = true;
@@ -0,0 +1,104 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockfilemap.h>
+
+#include <compat.h>
+#include <logging.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+}
+
+std::shared_ptr<const MappedFile> MappedFile::Open(const fs::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        LogPrintf("Cannot map %s: %s\n", path.string(), strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+    // The mapping keeps the file referenced on its own.
+    close(fd);
+    return std::make_shared<const MappedFile>(static_cast<const unsigned char*>(data), st.st_size);
+#else
+    return nullptr;
+#endif
+}
+
+bool BlockFileMap::IsSupported()
+{
+#ifndef WIN32
+    // Block files are up to 128 MiB each, too much address space to spend on
+    // 32-bit platforms.
+    return sizeof(void*) >= 8;
+#else
+    return false;
+#endif
+}
+
+std::shared_ptr<const MappedFile> BlockFileMap::Get(int n_file, const fs::path& path, size_t min_size)
+{
+    if (!IsSupported() || m_max_files == 0) {
+        return nullptr;
+    }
+
+    LOCK(m_mutex);
+    auto it = m_files.find(n_file);
+    if (it != m_files.end() && it->second.path == path && it->second.mapping->size() >= min_size) {
+        it->second.last_used = ++m_use_counter;
+        return it->second.mapping;
+    }
+
+    // Not mapped yet, the file has grown since, or the blocks directory changed.
+    std::shared_ptr<const MappedFile> mapping = MappedFile::Open(path);
+    if (!mapping) {
+        return nullptr;
+    }
+    m_files[n_file] = Entry{mapping, path, ++m_use_counter};
+
+    if (m_files.size() > m_max_files) {
+        auto oldest = m_files.begin();
+        for (auto iter = m_files.begin(); iter != m_files.end(); ++iter) {
+            if (iter->second.last_used < oldest->second.last_used) oldest = iter;
+        }
+        m_files.erase(oldest);
+    }
+
+    if (mapping->size() < min_size) {
+        return nullptr;
+    }
+    return mapping;
+}
+
+void BlockFileMap::Drop(int n_file)
+{
+    LOCK(m_mutex);
+    m_files.erase(n_file);
+}
+
+void BlockFileMap::Clear()
+{
+    LOCK(m_mutex);
+    m_files.clear();
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKFILEMAP_H
+#define BITCOIN_NODE_BLOCKFILEMAP_H
+
+#include <fs.h>
+#include <span.h>
+#include <sync.h>
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+
+/** Default for -mapblockfiles. */
+static const bool DEFAULT_MAP_BLOCK_FILES = true;
+/** Number of block files kept mapped at once. */
+static const size_t MAX_MAPPED_BLOCK_FILES = 64;
+
+/** A read-only memory mapping of a whole file, unmapped when the last reference goes. */
+class MappedFile
+{
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+
+public:
+    MappedFile(const unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    size_t size() const { return m_size; }
+    Span<const unsigned char> GetSpan() const { return Span<const unsigned char>(m_data, m_size); }
+
+    /** Map the file at path, or return nullptr if it cannot be mapped. */
+    static std::shared_ptr<const MappedFile> Open(const fs::path& path);
+};
+
+/**
+ * Read-only mappings of the block files (blk?????.dat), so blocks can be
+ * parsed straight from the page cache instead of being copied through a
+ * FILE* buffer on every read.
+ *
+ * Files are mapped whole, at their size when first needed. The file being
+ * written to keeps growing, so a read past the end of a mapping maps the file
+ * again. Readers hold a reference to the mapping they parse from; mappings
+ * evicted meanwhile stay valid until they are done. Only the least recently
+ * used files are kept, to bound the address space used.
+ *
+ * Mapping is not available on Windows or 32-bit platforms, where Get() always
+ * returns nullptr and callers read the file instead.
+ */
+class BlockFileMap
+{
+private:
+    struct Entry {
+        std::shared_ptr<const MappedFile> mapping;
+        fs::path path;
+        uint64_t last_used;
+    };
+
+    Mutex m_mutex;
+    std::map<int, Entry> m_files GUARDED_BY(m_mutex);
+    uint64_t m_use_counter GUARDED_BY(m_mutex) = 0;
+    const size_t m_max_files;
+
+public:
+    explicit BlockFileMap(size_t max_files = MAX_MAPPED_BLOCK_FILES) : m_max_files(max_files) {}
+
+    /** Whether files can be mapped on this platform. */
+    static bool IsSupported();
+
+    /**
+     * Return a mapping of file number n_file at path that covers at least
+     * min_size bytes, or nullptr if the file is shorter or cannot be mapped.
+     */
+    std::shared_ptr<const MappedFile> Get(int n_file, const fs::path& path, size_t min_size);
+
+    /** Forget the mapping of a file, e.g. because it is about to be deleted. */
+    void Drop(int n_file);
+
+    /** Forget all mappings. */
+    void Clear();
+};
+
+#endif // BITCOIN_NODE_BLOCKFILEMAP_H
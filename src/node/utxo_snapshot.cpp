@@ -0,0 +1,133 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/utxo_snapshot.h>
+
+#include <coins.h>
+#include <hash.h>
+#include <memusage.h>
+#include <node/coinstats.h>
+#include <streams.h>
+#include <txdb.h>
+#include <util/system.h>
+
+#include <map>
+
+#include <boost/thread/thread.hpp> // boost::thread::interrupt
+
+static void WriteCoins(CAutoFile& file, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    file << hash;
+    WriteCompactSize(file, outputs.size());
+    for (const auto& output : outputs) {
+        file << VARINT(output.first);
+        file << output.second;
+    }
+}
+
+bool WriteUTXOSnapshot(CCoinsViewCursor& cursor, CAutoFile& file, SnapshotMetadata& metadata, CCoinsStats& stats)
+{
+    metadata.m_base_blockhash = cursor.GetBestBlock();
+    metadata.m_coins_count = 0;
+    stats.hashBlock = metadata.m_base_blockhash;
+
+    try {
+        file << metadata;
+
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << stats.hashBlock;
+        uint256 prevkey;
+        std::map<uint32_t, Coin> outputs;
+        while (cursor.Valid()) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            if (!cursor.GetKey(key) || !cursor.GetValue(coin))
+                return error("%s: unable to read value", __func__);
+            if (!outputs.empty() && key.hash != prevkey) {
+                ApplyStats(stats, ss, prevkey, outputs);
+                WriteCoins(file, prevkey, outputs);
+                outputs.clear();
+            }
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
+            metadata.m_coins_count++;
+            cursor.Next();
+        }
+        if (!outputs.empty()) {
+            ApplyStats(stats, ss, prevkey, outputs);
+            WriteCoins(file, prevkey, outputs);
+        }
+        stats.hashSerialized = ss.GetHash();
+
+        // Now that the number of coins is known, rewrite the metadata
+        if (fseek(file.Get(), 0, SEEK_SET) != 0)
+            return error("%s: unable to rewind the snapshot file", __func__);
+        file << metadata;
+        if (!FileCommit(file.Get()))
+            return error("%s: FileCommit failed", __func__);
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool ReadUTXOSnapshot(CAutoFile& file, const SnapshotMetadata& metadata, CCoinsStats& stats, CCoinsViewDB* db, size_t nBatchBytes)
+{
+    stats.hashBlock = metadata.m_base_blockhash;
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << stats.hashBlock;
+    CCoinsMap coins;
+    size_t nCoinsUsage = 0;
+    uint64_t nCoinsLeft = metadata.m_coins_count;
+    try {
+        while (nCoinsLeft > 0) {
+            boost::this_thread::interruption_point();
+            uint256 hash;
+            file >> hash;
+            uint64_t count = ReadCompactSize(file);
+            if (count == 0 || count > nCoinsLeft)
+                return error("%s: bad number of outputs of %s", __func__, hash.ToString());
+            std::map<uint32_t, Coin> outputs;
+            for (uint64_t i = 0; i < count; i++) {
+                uint32_t n;
+                file >> VARINT(n);
+                Coin& coin = outputs[n];
+                file >> coin;
+                if (coin.IsSpent())
+                    return error("%s: spent output %s:%u", __func__, hash.ToString(), n);
+            }
+            if (outputs.size() != count)
+                return error("%s: duplicate outputs of %s", __func__, hash.ToString());
+            ApplyStats(stats, ss, hash, outputs);
+            nCoinsLeft -= count;
+
+            if (!db)
+                continue;
+            for (auto& output : outputs) {
+                nCoinsUsage += output.second.DynamicMemoryUsage();
+                CCoinsCacheEntry& entry = coins[COutPoint(hash, output.first)];
+                entry.coin = std::move(output.second);
+                entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+            }
+            if (nCoinsUsage + memusage::DynamicUsage(coins) > nBatchBytes) {
+                if (!db->BatchWrite(coins, metadata.m_base_blockhash, false))
+                    return error("%s: failed to write coins", __func__);
+                // Release the map's pooled memory too, so that its usage
+                // restarts from zero like nCoinsUsage
+                coins = CCoinsMap();
+                nCoinsUsage = 0;
+            }
+        }
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    if (fgetc(file.Get()) != EOF)
+        return error("%s: trailing data after %u coins", __func__, metadata.m_coins_count);
+    if (db && !db->BatchWrite(coins, metadata.m_base_blockhash, false))
+        return error("%s: failed to write coins", __func__);
+    stats.hashSerialized = ss.GetHash();
+    return true;
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_UTXO_SNAPSHOT_H
+#define BITCOIN_NODE_UTXO_SNAPSHOT_H
+
+#include <protocol.h>
+#include <serialize.h>
+#include <tinyformat.h>
+#include <uint256.h>
+
+#include <cstring>
+#include <ios>
+
+class CAutoFile;
+class CCoinsViewCursor;
+class CCoinsViewDB;
+struct CCoinsStats;
+
+//! Magic bytes at the start of a UTXO snapshot file
+static const unsigned char SNAPSHOT_MAGIC_BYTES[5] = {'u', 't', 'x', 'o', 0xff};
+//! Version of the UTXO snapshot file format written by dumptxoutset
+static const uint16_t SNAPSHOT_VERSION = 1;
+
+/**
+ * Metadata at the start of a UTXO snapshot file. It is followed by the coins,
+ * grouped by transaction in coins database order: the txid, the number of its
+ * unspent outputs, then the output index and the Coin of each.
+ */
+class SnapshotMetadata
+{
+public:
+    CMessageHeader::MessageStartChars m_network_magic = {};
+    //! The block the UTXO set is the state of
+    uint256 m_base_blockhash;
+    uint64_t m_coins_count = 0;
+
+    SnapshotMetadata() {}
+    SnapshotMetadata(const CMessageHeader::MessageStartChars& network_magic, const uint256& base_blockhash, uint64_t coins_count) :
+        m_base_blockhash(base_blockhash), m_coins_count(coins_count)
+    {
+        memcpy(m_network_magic, network_magic, sizeof(m_network_magic));
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        unsigned char magic[sizeof(SNAPSHOT_MAGIC_BYTES)];
+        memcpy(magic, SNAPSHOT_MAGIC_BYTES, sizeof(magic));
+        READWRITE(magic);
+        if (memcmp(magic, SNAPSHOT_MAGIC_BYTES, sizeof(magic)) != 0)
+            throw std::ios_base::failure("Not a UTXO snapshot file");
+        uint16_t version = SNAPSHOT_VERSION;
+        READWRITE(version);
+        if (version != SNAPSHOT_VERSION)
+            throw std::ios_base::failure(strprintf("Unsupported UTXO snapshot version %u", version));
+        READWRITE(m_network_magic);
+        READWRITE(m_base_blockhash);
+        READWRITE(m_coins_count);
+    }
+};
+
+/**
+ * Write the coins database at the cursor to file as a snapshot, computing the
+ * statistics GetUTXOStats() would. The metadata is written first and updated
+ * with the number of coins at the end.
+ */
+bool WriteUTXOSnapshot(CCoinsViewCursor& cursor, CAutoFile& file, SnapshotMetadata& metadata, CCoinsStats& stats);
+
+/**
+ * Read the coins following the metadata of a snapshot, computing the
+ * statistics GetUTXOStats() would for them. If db is given they are also
+ * written to it, in batches of about nBatchBytes of memory. The database is
+ * left marked as being in transition to the snapshot base block; the caller
+ * flushes that block as the best one once it has checked the statistics.
+ */
+bool ReadUTXOSnapshot(CAutoFile& file, const SnapshotMetadata& metadata, CCoinsStats& stats, CCoinsViewDB* db = nullptr, size_t nBatchBytes = 0);
+
+#endif // BITCOIN_NODE_UTXO_SNAPSHOT_H
@@ -9,7 +9,6 @@
 #include <chain.h>
 #include <primitives/block.h>
 #include <uint256.h>
-#include <bignum.h>
 
 #include <math.h>
 
@@ -86,9 +85,7 @@ unsigned int GetNextWorkRequired_V1(const CBlockIndex* pindexLast, const CBlockH
     if (pindexLast->nHeight > params.nCoinFix)
         blockstogoback = nReTargetHistoryFact * nInterval ;
 
-    const CBlockIndex* pindexFirst = pindexLast;
-    for (int i = 0; pindexFirst && i < blockstogoback; i++)
-        pindexFirst = pindexFirst->pprev;
+    const CBlockIndex* pindexFirst = pindexLast->GetAncestor(pindexLast->nHeight - blockstogoback);
     assert(pindexFirst);
 
     if (params.fPowNoRetargeting)
@@ -126,7 +123,7 @@ unsigned int GetNextWorkRequired_V1(const CBlockIndex* pindexLast, const CBlockH
 
 unsigned int GetNextWorkRequired_V2(const CBlockIndex* pindexLast, const Consensus::Params& params)
 {
-    CBigNum bnProofOfWorkLimit;
+    arith_uint256 bnProofOfWorkLimit;
     bnProofOfWorkLimit.SetCompact(504365055);
     int64_t nTargetTimespan = 60 * 60;
     int64_t PastSecondsMin = nTargetTimespan * 0.025;
@@ -141,8 +138,8 @@ unsigned int GetNextWorkRequired_V2(const CBlockIndex* pindexLast, const Consens
     int64_t PastRateActualSeconds = 0;
     int64_t PastRateTargetSeconds = 0;
     double PastRateAdjustmentRatio = double(1);
-    CBigNum PastDifficultyAverage;
-    CBigNum PastDifficultyAveragePrev;
+    arith_uint256 PastDifficultyAverage;
+    arith_uint256 PastDifficultyAveragePrev;
     double EventHorizonDeviation;
     double EventHorizonDeviationFast;
     double EventHorizonDeviationSlow;
@@ -160,8 +157,15 @@ unsigned int GetNextWorkRequired_V2(const CBlockIndex* pindexLast, const Consens
 
         if (i == 1)
             PastDifficultyAverage.SetCompact(BlockReading->nBits);
-        else
-            PastDifficultyAverage = ((CBigNum().SetCompact(BlockReading->nBits) - PastDifficultyAveragePrev) / i) + PastDifficultyAveragePrev;
+        else {
+            // The average used to be computed with signed bignums, whose
+            // division truncates towards zero
+            arith_uint256 bnReading = arith_uint256().SetCompact(BlockReading->nBits);
+            if (bnReading >= PastDifficultyAveragePrev)
+                PastDifficultyAverage = ((bnReading - PastDifficultyAveragePrev) / arith_uint256(i)) + PastDifficultyAveragePrev;
+            else
+                PastDifficultyAverage = PastDifficultyAveragePrev - ((PastDifficultyAveragePrev - bnReading) / arith_uint256(i));
+        }
 
         PastDifficultyAveragePrev = PastDifficultyAverage;
 
@@ -203,17 +207,18 @@ unsigned int GetNextWorkRequired_V2(const CBlockIndex* pindexLast, const Consens
         BlockReading = BlockReading->pprev;
     }
 
-    CBigNum bnNew(PastDifficultyAverage);
+    // Both timespans are positive here; the product may not fit 256 bits
+    arith_uint512 bnNew(PastDifficultyAverage);
     if (PastRateActualSeconds != 0 && PastRateTargetSeconds != 0)
     {
-        bnNew *= PastRateActualSeconds;
-        bnNew /= PastRateTargetSeconds;
+        bnNew *= arith_uint512(PastRateActualSeconds);
+        bnNew /= arith_uint512(PastRateTargetSeconds);
     }
 
-    if (bnNew > bnProofOfWorkLimit)
-        bnNew = bnProofOfWorkLimit;
+    if (bnNew > arith_uint512(bnProofOfWorkLimit))
+        return bnProofOfWorkLimit.GetCompact();
 
-    return bnNew.GetCompact();
+    return bnNew.trim256().GetCompact();
 }
 
 /**
@@ -242,15 +247,13 @@ unsigned int GetNextWorkRequired_V3(const CBlockIndex* pindexLast, const Consens
     if (pindexLast == NULL || nHeight <= longSample + 1)
         return UintToArith256(params.powLimit).GetCompact();
 
-    const CBlockIndex* pindexFirstLong = pindexLast;
-    for(int i = 0; pindexFirstLong && i < longSample; i++) {
-        pindexFirstLong = pindexFirstLong->pprev;
-        if (i == shortSample - 1)
-            pindexFirstShortTime = pindexFirstLong->GetBlockTime();
-
-        if (i == mediumSample - 1)
-            pindexFirstMediumTime = pindexFirstLong->GetBlockTime();
-    }
+    // Only the first block of every sample matters; the skip list finds
+    // them without walking all longSample ancestors
+    const CBlockIndex* pindexFirstShort = pindexLast->GetAncestor(pindexLast->nHeight - shortSample);
+    const CBlockIndex* pindexFirstMedium = pindexFirstShort->GetAncestor(pindexLast->nHeight - mediumSample);
+    const CBlockIndex* pindexFirstLong = pindexFirstMedium->GetAncestor(pindexLast->nHeight - longSample);
+    pindexFirstShortTime = pindexFirstShort->GetBlockTime();
+    pindexFirstMediumTime = pindexFirstMedium->GetBlockTime();
 
     if (pindexLast->GetBlockTime() - pindexFirstShortTime != 0)
         nActualTimespanShort = (pindexLast->GetBlockTime() - pindexFirstShortTime) / shortSample;
@@ -294,6 +297,13 @@ unsigned int GetNextWorkRequired_V3(const CBlockIndex* pindexLast, const Consens
     return bnNew.GetCompact();
 }
 
+unsigned int GetPoWProfile(const CBlockHeader& block, const Consensus::Params& params)
+{
+    if (block.GetBlockTime() >= params.nNeoScryptFork)
+        return 0x0;
+    return 0x3;
+}
+
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params& params)
 {
     bool fNegative;
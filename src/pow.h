@@ -20,6 +20,9 @@ unsigned int GetNextWorkRequired_V2(const CBlockIndex* pindexLast, const Consens
 unsigned int GetNextWorkRequired_V3(const CBlockIndex* pindexLast, const Consensus::Params&);
 unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nFirstBlockTime, const Consensus::Params&);
 
+/** NeoScrypt profile a block header is hashed with: Scrypt until the NeoScrypt fork */
+unsigned int GetPoWProfile(const CBlockHeader& block, const Consensus::Params&);
+
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
 
@@ -0,0 +1,216 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <powcache.h>
+
+#include <chain.h>
+#include <clientversion.h>
+#include <crypto/sha256.h>
+#include <cuckoocache.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <script/sigcache.h>
+#include <streams.h>
+#include <uint256.h>
+#include <util/system.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <atomic>
+
+#include <boost/thread.hpp>
+
+namespace {
+
+static const uint64_t POW_CACHE_DUMP_VERSION = 2;
+
+/**
+ * Valid proof-of-work cache, to avoid NeoScrypt hashing a header more than
+ * once: when the header arrives, when the full block arrives, when it is read
+ * back from disk, and again on -reindex or verifychain.
+ */
+class CPoWCache
+{
+private:
+    //! Entries are SHA256(nonce || block hash)
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_powcache;
+    size_t nElems = 0;
+
+public:
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
+
+    CPoWCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_powcache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_powcache);
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        nElems = setValid.setup_bytes(n);
+        return nElems;
+    }
+
+    size_t size() const { return nElems; }
+};
+
+static CPoWCache powCache;
+} // namespace
+
+void InitPoWCache()
+{
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxpowcachesize", DEFAULT_MAX_POW_CACHE_SIZE)), MAX_MAX_POW_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = powCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for proof-of-work cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+bool IsPoWCached(const uint256& hash)
+{
+    uint256 entry;
+    powCache.ComputeEntry(entry, hash);
+    if (powCache.Get(entry)) {
+        ++powCache.nHits;
+        return true;
+    }
+    ++powCache.nMisses;
+    return false;
+}
+
+void AddPoWCacheEntry(const uint256& hash)
+{
+    uint256 entry;
+    powCache.ComputeEntry(entry, hash);
+    powCache.Set(entry);
+}
+
+bool CheckProofOfWorkCached(const CBlockHeader& block, const Consensus::Params& params)
+{
+    const uint256 hash = block.GetHash();
+    if (IsPoWCached(hash))
+        return true;
+    if (!CheckProofOfWork(block.GetPoWHash(GetPoWProfile(block, params)), block.nBits, params))
+        return false;
+    AddPoWCacheEntry(hash);
+    return true;
+}
+
+PoWCacheStats GetPoWCacheStats()
+{
+    PoWCacheStats stats;
+    stats.hits = powCache.nHits;
+    stats.misses = powCache.nMisses;
+    stats.elements = powCache.size();
+    return stats;
+}
+
+bool DumpPoWCache()
+{
+    int64_t start = GetTimeMicros();
+
+    // Only headers we still know about are worth keeping; the cache itself
+    // holds salted entries and cannot be enumerated.
+    std::vector<uint256> vHash;
+    uint256 hashTip;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.empty() || !chainActive.Tip())
+            return false;
+        hashTip = chainActive.Tip()->GetBlockHash();
+        vHash.reserve(mapBlockIndex.size());
+        for (const auto& item : mapBlockIndex) {
+            vHash.push_back(item.first);
+        }
+    }
+    std::vector<uint256> vValid;
+    vValid.reserve(vHash.size());
+    for (const uint256& hash : vHash) {
+        uint256 entry;
+        powCache.ComputeEntry(entry, hash);
+        if (powCache.Get(entry))
+            vValid.push_back(hash);
+    }
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "powcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << POW_CACHE_DUMP_VERSION;
+        file << hashTip;
+        file << vValid;
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        RenameOver(GetDataDir() / "powcache.dat.new", GetDataDir() / "powcache.dat");
+        LogPrintf("Dumped %u proof-of-work cache entries: %gs\n", vValid.size(), (GetTimeMicros() - start) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump proof-of-work cache: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadPoWCache()
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "powcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open proof-of-work cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    std::vector<uint256> vValid;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != POW_CACHE_DUMP_VERSION) {
+            return false;
+        }
+        uint256 hashTip;
+        file >> hashTip;
+        {
+            // Entries saved with another chain, e.g. a different datadir or
+            // network copied in, must not skip proof-of-work checks here.
+            LOCK(cs_main);
+            if (!chainActive.Tip() || chainActive.Tip()->GetBlockHash() != hashTip) {
+                LogPrintf("Proof-of-work cache file was saved at another chain tip, ignoring it\n");
+                return false;
+            }
+        }
+        file >> vValid;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize proof-of-work cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    for (const uint256& hash : vValid) {
+        AddPoWCacheEntry(hash);
+    }
+    LogPrintf("Imported %u proof-of-work cache entries from disk\n", vValid.size());
+    return true;
+}
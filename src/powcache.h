@@ -0,0 +1,54 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_POWCACHE_H
+#define BITCOIN_POWCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+class CBlockHeader;
+class uint256;
+
+namespace Consensus { struct Params; }
+
+// Enough for over 1000000 headers, i.e. the whole chain, on 64-bit systems
+static const unsigned int DEFAULT_MAX_POW_CACHE_SIZE = 32;
+// Maximum PoW cache size allowed
+static const int64_t MAX_MAX_POW_CACHE_SIZE = 16384;
+/** Default for -persistpowcache */
+static const bool DEFAULT_PERSIST_POW_CACHE = true;
+
+struct PoWCacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    size_t elements;
+};
+
+/** Initialize the PoW cache, to be called once in AppInitMain/BasicTestingSetup. */
+void InitPoWCache();
+
+/**
+ * CheckProofOfWork() of the header's NeoScrypt hash. Headers known to have a
+ * valid proof of work (by block hash) are not hashed again; newly verified
+ * headers are added to the cache.
+ */
+bool CheckProofOfWorkCached(const CBlockHeader& block, const Consensus::Params& params);
+
+/** Whether the header with this block hash is known to have a valid proof of work. Counts as a hit or miss. */
+bool IsPoWCached(const uint256& hash);
+
+/** Record that the header with this block hash has a valid proof of work. */
+void AddPoWCacheEntry(const uint256& hash);
+
+PoWCacheStats GetPoWCacheStats();
+
+/** Dump the cached entries of all headers in mapBlockIndex to disk, along with the chain tip. */
+bool DumpPoWCache();
+
+/** Load the entries saved by DumpPoWCache(), unless they were saved at another chain tip. Call once the chain is loaded. */
+bool LoadPoWCache();
+
+#endif // BITCOIN_POWCACHE_H
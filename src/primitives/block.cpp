@@ -25,6 +25,21 @@ uint256 CBlockHeader::GetPoWHash(unsigned int profile) const
     return(hash);
 }
 
+void CBlockHeader::GetPoWHashes(const CBlockHeader* headers, size_t count, unsigned int profile, uint256* hashes)
+{
+    static const size_t HEADER_SIZE = 80;
+    std::vector<unsigned char> input(count * HEADER_SIZE);
+    std::vector<unsigned char> output(count * 32);
+
+    for (size_t i = 0; i < count; i++)
+        memcpy(&input[i * HEADER_SIZE], &headers[i].nVersion, HEADER_SIZE);
+
+    neoscrypt_multi(input.data(), output.data(), count, profile);
+
+    for (size_t i = 0; i < count; i++)
+        memcpy(hashes[i].begin(), &output[i * 32], 32);
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
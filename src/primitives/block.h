@@ -64,6 +64,9 @@ public:
 
     uint256 GetPoWHash(unsigned int profile) const;
 
+    /** Compute GetPoWHash() of count headers at once, using the multi-lane NeoScrypt engines */
+    static void GetPoWHashes(const CBlockHeader* headers, size_t count, unsigned int profile, uint256* hashes);
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
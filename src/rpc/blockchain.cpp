@@ -11,13 +11,18 @@
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <checkpointsync.h>
+#include <clientversion.h>
 #include <coins.h>
 #include <consensus/validation.h>
 #include <keystore.h>
 #include <core_io.h>
 #include <hash.h>
+#include <index/coinstatsindex.h>
 #include <index/txindex.h>
 #include <key_io.h>
+#include <net.h>
+#include <node/coinstats.h>
+#include <node/utxo_snapshot.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -999,77 +1004,6 @@ static UniValue sendcheckpoint(const JSONRPCRequest& request)
     return result;
 }
 
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nBogoSize;
-    uint256 hashSerialized;
-    uint64_t nDiskSize;
-    CAmount nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
-};
-
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
-{
-    assert(!outputs.empty());
-    ss << hash;
-    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase ? 1u : 0u);
-    stats.nTransactions++;
-    for (const auto& output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << output.second.out.scriptPubKey;
-        ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
-        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
-                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
-    }
-    ss << VARINT(0u);
-}
-
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
-{
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
-    }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
-    }
-    stats.hashSerialized = ss.GetHash();
-    stats.nDiskSize = view->EstimateSize();
-    return true;
-}
-
 static UniValue pruneblockchain(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1128,48 +1062,129 @@ static UniValue pruneblockchain(const JSONRPCRequest& request)
     return uint64_t(block->nHeight);
 }
 
+//! Look up a block of the active chain by the hash_or_height RPC parameter
+static CBlockIndex* ParseHashOrHeight(const UniValue& param) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+
+    if (param.isNum()) {
+        const int height = param.get_int();
+        const int current_tip = chainActive.Height();
+        if (height < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
+        }
+        if (height > current_tip) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
+        }
+
+        return chainActive[height];
+    } else {
+        const uint256 hash(ParseHashV(param, "hash_or_height"));
+        CBlockIndex* pindex = LookupBlockIndex(hash);
+        if (!pindex) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        if (!chainActive.Contains(pindex)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Block is not in chain %s", Params().NetworkIDString()));
+        }
+        return pindex;
+    }
+}
+
+static CoinStatsHashType ParseHashType(const UniValue& param)
+{
+    const std::string hash_type_input = param.isNull() ? "hash_serialized_2" : param.get_str();
+    if (hash_type_input == "hash_serialized_2") {
+        return CoinStatsHashType::HASH_SERIALIZED;
+    } else if (hash_type_input == "muhash") {
+        return CoinStatsHashType::MUHASH;
+    } else if (hash_type_input == "none") {
+        return CoinStatsHashType::NONE;
+    }
+    throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hash_type_input));
+}
+
 static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 3)
         throw std::runtime_error(
             RPCHelpMan{"gettxoutsetinfo",
                 "\nReturns statistics about the unspent transaction output set.\n"
-                "Note this call may take some time.\n",
-                {},
+                "Note this call may take some time without the coinstats index.\n",
+                {
+                    {"hash_type", RPCArg::Type::STR, /* default */ "hash_serialized_2", "Which UTXO set hash should be calculated. Options: 'hash_serialized_2' (the legacy algorithm), 'muhash', 'none'."},
+                    {"hash_or_height", RPCArg::Type::NUM, /* default */ "the current best block", "The block hash or height of the target height (only available with coinstatsindex).", "", {"", "string or numeric"}},
+                    {"use_index", RPCArg::Type::BOOL, /* default */ "true", "Use coinstatsindex, if available."},
+                },
                 RPCResult{
             "{\n"
-            "  \"height\":n,     (numeric) The current block height (index)\n"
-            "  \"bestblock\": \"hex\",   (string) The hash of the block at the tip of the chain\n"
-            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs\n"
+            "  \"height\":n,     (numeric) The block height (index) of the returned statistics\n"
+            "  \"bestblock\": \"hex\",   (string) The hash of the block at which these statistics are calculated\n"
+            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs (not available when coinstatsindex is used)\n"
             "  \"txouts\": n,            (numeric) The number of unspent transaction outputs\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (only present if 'hash_serialized_2' hash_type is chosen)\n"
+            "  \"muhash\": \"hash\",     (string) The serialized hash (only present if 'muhash' hash_type is chosen)\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk (not available when coinstatsindex is used)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
                 },
                 RPCExamples{
                     HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"none\"")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\" 1000")
             + HelpExampleRpc("gettxoutsetinfo", "")
+            + HelpExampleRpc("gettxoutsetinfo", "\"none\"")
+            + HelpExampleRpc("gettxoutsetinfo", "\"muhash\", 1000")
                 },
             }.ToString());
 
     UniValue ret(UniValue::VOBJ);
 
+    const CoinStatsHashType hash_type = ParseHashType(request.params[0]);
+    const bool use_index = request.params[2].isNull() ? true : request.params[2].get_bool();
+
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview.get(), stats)) {
-        ret.pushKV("height", (int64_t)stats.nHeight);
-        ret.pushKV("bestblock", stats.hashBlock.GetHex());
+    // The index only maintains the MuHash, and can answer for past blocks.
+    const bool index_used = use_index && g_coin_stats_index && hash_type != CoinStatsHashType::HASH_SERIALIZED;
+    if (index_used) {
+        g_coin_stats_index->BlockUntilSyncedToCurrentChain();
+
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            pindex = request.params[1].isNull() ? chainActive.Tip() : ParseHashOrHeight(request.params[1]);
+        }
+        if (!g_coin_stats_index->LookUpStats(pindex, stats)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set, the coinstats index may still be syncing");
+        }
+    } else {
+        if (!request.params[1].isNull()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Querying specific block heights requires coinstatsindex and a hash_type other than hash_serialized_2");
+        }
+
+        FlushStateToDisk();
+        if (!GetUTXOStats(pcoinsdbview.get(), stats, hash_type)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        }
+    }
+
+    ret.pushKV("height", (int64_t)stats.nHeight);
+    ret.pushKV("bestblock", stats.hashBlock.GetHex());
+    if (!index_used) {
         ret.pushKV("transactions", (int64_t)stats.nTransactions);
-        ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
-        ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
+    }
+    ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
+    ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
+    if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
         ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+    } else if (hash_type == CoinStatsHashType::MUHASH) {
+        ret.pushKV("muhash", stats.hashSerialized.GetHex());
+    }
+    if (!index_used) {
         ret.pushKV("disk_size", stats.nDiskSize);
-        ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
-    } else {
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
     }
+    ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
     return ret;
 }
 
@@ -1936,30 +1951,7 @@ static UniValue getblockstats(const JSONRPCRequest& request)
 
     LOCK(cs_main);
 
-    CBlockIndex* pindex;
-    if (request.params[0].isNum()) {
-        const int height = request.params[0].get_int();
-        const int current_tip = chainActive.Height();
-        if (height < 0) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
-        }
-        if (height > current_tip) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
-        }
-
-        pindex = chainActive[height];
-    } else {
-        const uint256 hash(ParseHashV(request.params[0], "hash_or_height"));
-        pindex = LookupBlockIndex(hash);
-        if (!pindex) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-        }
-        if (!chainActive.Contains(pindex)) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Block is not in chain %s", Params().NetworkIDString()));
-        }
-    }
-
-    assert(pindex != nullptr);
+    CBlockIndex* pindex = ParseHashOrHeight(request.params[0]);
 
     std::set<std::string> stats;
     if (!request.params[1].isNull()) {
@@ -2164,6 +2156,195 @@ static UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            RPCHelpMan{"dumptxoutset",
+                "\nWrite the current UTXO set to a file, as a snapshot that loadtxoutset can load.\n",
+                {
+                    {"path", RPCArg::Type::STR, RPCArg::Optional::NO, "The path of the snapshot file; relative paths are prefixed by the data directory"},
+                },
+                RPCResult{
+            "{\n"
+            "  \"coins_written\": n,           (numeric) The number of coins written to the snapshot\n"
+            "  \"base_hash\": \"hash\",          (string) The hash of the block the UTXO set is the state of\n"
+            "  \"base_height\": n,             (numeric) The height of that block\n"
+            "  \"nchaintx\": n,                (numeric) The number of transactions up to and including that block\n"
+            "  \"hash_serialized_2\": \"hash\",  (string) The serialized hash of the UTXO set, as in gettxoutsetinfo\n"
+            "  \"path\": \"path\",               (string) The absolute path of the snapshot file\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+                },
+            }.ToString());
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    // Write to a temporary file and move it into place once complete
+    const fs::path temppath = path.string() + ".incomplete";
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    }
+
+    CAutoFile file(fsbridge::fopen(temppath, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to open " + temppath.string() + " for writing");
+    }
+
+    // The cursor iterates over a consistent view of the coins database, so
+    // cs_main is only held to get it and its base block.
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    const CBlockIndex* pindexBase;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(pcoinsdbview->Cursor());
+        pindexBase = LookupBlockIndex(pcursor->GetBestBlock());
+    }
+    assert(pindexBase);
+
+    SnapshotMetadata metadata(Params().MessageStart(), pindexBase->GetBlockHash(), 0);
+    CCoinsStats stats;
+    if (!WriteUTXOSnapshot(*pcursor, file, metadata, stats)) {
+        file.fclose();
+        fs::remove(temppath);
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to write the UTXO set snapshot");
+    }
+    file.fclose();
+    fs::rename(temppath, path);
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("coins_written", (int64_t)metadata.m_coins_count);
+    result.pushKV("base_hash", pindexBase->GetBlockHash().GetHex());
+    result.pushKV("base_height", pindexBase->nHeight);
+    result.pushKV("nchaintx", (int64_t)pindexBase->nChainTx);
+    result.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+    result.pushKV("path", path.string());
+    return result;
+}
+
+static UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            RPCHelpMan{"loadtxoutset",
+                "\nLoad a UTXO set snapshot written by dumptxoutset, instead of validating the chain up to its base block.\n"
+                "The node must not have synced past the genesis block, must know the header of the base block, and\n"
+                "the snapshot must match the one trusted for that height by the chain parameters.\n"
+                "Blocks below the base block are treated like pruned ones afterwards, and the node only offers\n"
+                "NODE_NETWORK_LIMITED to its peers.\n"
+                "If loading is interrupted, the data directory has to be wiped.\n",
+                {
+                    {"path", RPCArg::Type::STR, RPCArg::Optional::NO, "The path of the snapshot file; relative paths are prefixed by the data directory"},
+                },
+                RPCResult{
+            "{\n"
+            "  \"coins_loaded\": n,            (numeric) The number of coins loaded from the snapshot\n"
+            "  \"base_hash\": \"hash\",          (string) The hash of the block the UTXO set is the state of, now the chain tip\n"
+            "  \"base_height\": n,             (numeric) The height of that block\n"
+            "  \"path\": \"path\",               (string) The absolute path of the snapshot file\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("loadtxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("loadtxoutset", "\"utxo.dat\"")
+                },
+            }.ToString());
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unable to open " + path.string());
+    }
+    SnapshotMetadata metadata;
+    try {
+        file >> metadata;
+    } catch (const std::exception& e) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("Unable to read the snapshot metadata: %s", e.what()));
+    }
+    if (memcmp(metadata.m_network_magic, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "The snapshot is for another network");
+    }
+
+    CBlockIndex* pindexBase;
+    AssumeutxoData trusted;
+    {
+        LOCK(cs_main);
+        pindexBase = LookupBlockIndex(metadata.m_base_blockhash);
+        if (!pindexBase) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "The header of the snapshot base block " + metadata.m_base_blockhash.GetHex() + " is not known yet");
+        }
+        const auto itAssumeutxo = Params().Assumeutxo().find(pindexBase->nHeight);
+        if (itAssumeutxo == Params().Assumeutxo().end()) {
+            throw JSONRPCError(RPC_VERIFY_REJECTED, strprintf("No UTXO set snapshot is trusted at height %d", pindexBase->nHeight));
+        }
+        trusted = itAssumeutxo->second;
+        if (chainActive.Height() != 0) {
+            throw JSONRPCError(RPC_MISC_ERROR, "A snapshot can only be loaded by a node that has not synced past the genesis block");
+        }
+    }
+
+    // Check the snapshot before writing anything, without holding up the node
+    CCoinsStats stats;
+    if (!ReadUTXOSnapshot(file, metadata, stats)) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Unable to read the UTXO set snapshot");
+    }
+    if (stats.hashSerialized != trusted.hash_serialized) {
+        throw JSONRPCError(RPC_VERIFY_REJECTED, strprintf("The snapshot hash %s does not match the trusted hash %s",
+            stats.hashSerialized.GetHex(), trusted.hash_serialized.GetHex()));
+    }
+
+    if (fseek(file.Get(), 0, SEEK_SET) != 0) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to rewind " + path.string());
+    }
+    try {
+        file >> metadata;
+    } catch (const std::exception& e) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("Unable to read the snapshot metadata: %s", e.what()));
+    }
+
+    {
+        // Nothing else may touch the coins database while it is written
+        LOCK(cs_main);
+        if (chainActive.Height() != 0) {
+            throw JSONRPCError(RPC_MISC_ERROR, "A snapshot can only be loaded by a node that has not synced past the genesis block");
+        }
+        FlushStateToDisk();
+        {
+            std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+            if (pcursor->Valid()) {
+                throw JSONRPCError(RPC_MISC_ERROR, "The coins database is not empty");
+            }
+        }
+
+        // The file is read again, so check that it is still what was verified
+        CCoinsStats statsLoaded;
+        if (!ReadUTXOSnapshot(file, metadata, statsLoaded, pcoinsdbview.get(), nCoinCacheUsage) ||
+            statsLoaded.hashSerialized != stats.hashSerialized) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to load the UTXO set snapshot; the data directory has to be wiped");
+        }
+
+        pcoinsTip->SetBestBlock(pindexBase->GetBlockHash());
+        if (!ActivateSnapshotTip(pindexBase, trusted.nChainTx, Params())) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to activate the snapshot base block; the data directory has to be wiped");
+        }
+        FlushStateToDisk();
+    }
+    // Blocks below the snapshot were never downloaded, so only recent ones can be served
+    if (g_connman) {
+        g_connman->RemoveLocalServices(NODE_NETWORK);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("coins_loaded", (int64_t)metadata.m_coins_count);
+    result.pushKV("base_hash", pindexBase->GetBlockHash().GetHex());
+    result.pushKV("base_height", pindexBase->nHeight);
+    result.pushKV("path", path.string());
+    return result;
+}
+
 //! Search for a given set of pubkey scripts
 bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results) {
     scan_progress = 0;
@@ -2414,9 +2595,11 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type", "hash_or_height", "use_index"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           {"path"} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
 
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
@@ -9,7 +9,10 @@
 
 #include <univalue.h>
 
-/** Generate blocks (mine) */
-UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript);
+/** Default for -genproclimit, the number of nonce search threads of generateBlocks() */
+static const int DEFAULT_GENERATE_THREADS = 1;
+
+/** Generate blocks (mine), searching nonces on nThreads threads (all cores if < 1) */
+UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript, int nThreads);
 
 #endif
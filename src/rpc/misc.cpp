@@ -7,12 +7,14 @@
 #include <clientversion.h>
 #include <core_io.h>
 #include <crypto/ripemd160.h>
+#include <dbwrapper.h>
 #include <key_io.h>
 #include <validation.h>
 #include <httpserver.h>
 #include <net.h>
 #include <netbase.h>
 #include <outputtype.h>
+#include <powcache.h>
 #include <rpc/blockchain.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
@@ -413,6 +415,16 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCPoWCacheInfo()
+{
+    PoWCacheStats stats = GetPoWCacheStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("hits", stats.hits);
+    obj.pushKV("misses", stats.misses);
+    obj.pushKV("size", uint64_t(stats.elements));
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -456,6 +468,11 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"powcache\": {             (json object) Information about the proof-of-work cache\n"
+            "    \"hits\": xxxxx,          (numeric) Number of headers whose proof of work did not need to be hashed again\n"
+            "    \"misses\": xxxxx,        (numeric) Number of headers that were not in the cache\n"
+            "    \"size\": xxxxx,          (numeric) Maximum number of entries\n"
             "  }\n"
             "}\n"
                     },
@@ -473,6 +490,7 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.pushKV("locked", RPCLockedMemoryInfo());
+        obj.pushKV("powcache", RPCPoWCacheInfo());
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -485,6 +503,58 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
     }
 }
 
+static UniValue getdbstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            RPCHelpMan{"getdbstats",
+                "Returns the LevelDB settings and statistics of each open database.\n",
+                {},
+                RPCResult{
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",             (string) Name of the database directory\n"
+            "    \"path\": \"xxxx\",             (string) Location of the database\n"
+            "    \"profile\": \"xxxx\",          (string) Access pattern the settings are tuned for (chainstate, blocktree, index or default)\n"
+            "    \"block_cache_size\": xxxxx,    (numeric) Capacity of the block cache in bytes\n"
+            "    \"block_cache_usage\": xxxxx,   (numeric) Bytes held in the block cache\n"
+            "    \"write_buffer_size\": xxxxx,   (numeric) Size of each of the up to two write buffers in bytes\n"
+            "    \"block_size\": xxxxx,          (numeric) Uncompressed size of a table block in bytes\n"
+            "    \"bloom_bits_per_key\": xx,     (numeric) Bits per key of the bloom filter, 0 if there is none\n"
+            "    \"compression\": true|false,    (boolean) Whether table blocks are compressed\n"
+            "    \"max_file_size\": xxxxx,       (numeric) Size at which a table file is closed in bytes\n"
+            "    \"memory_usage\": xxxxx,        (numeric) LevelDB's estimate of its memory usage in bytes\n"
+            "    \"stats\": \"xxxx\"             (string) LevelDB's statistics of files and compactions per level\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+                },
+            }.ToString());
+
+    UniValue result(UniValue::VARR);
+    for (const DBStats& stats : GetDBStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", stats.name);
+        obj.pushKV("path", stats.path);
+        obj.pushKV("profile", stats.profile);
+        obj.pushKV("block_cache_size", (uint64_t)stats.block_cache_size);
+        obj.pushKV("block_cache_usage", (uint64_t)stats.block_cache_usage);
+        obj.pushKV("write_buffer_size", (uint64_t)stats.write_buffer_size);
+        obj.pushKV("block_size", (uint64_t)stats.block_size);
+        obj.pushKV("bloom_bits_per_key", stats.bloom_bits_per_key);
+        obj.pushKV("compression", stats.compression);
+        obj.pushKV("max_file_size", (uint64_t)stats.max_file_size);
+        obj.pushKV("memory_usage", (uint64_t)stats.memory_usage);
+        obj.pushKV("stats", stats.leveldb_stats);
+        result.push_back(obj);
+    }
+    return result;
+}
+
 static void EnableOrDisableLogCategories(UniValue cats, bool enable) {
     cats = cats.get_array();
     for (unsigned int i = 0; i < cats.size(); ++i) {
@@ -596,6 +666,7 @@ static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getmemoryinfo",          &getmemoryinfo,          {"mode"} },
+    { "control",            "getdbstats",             &getdbstats,             {} },
     { "control",            "logging",                &logging,                {"include", "exclude"}},
     { "util",               "validateaddress",        &validateaddress,        {"address"} },
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys","address_type"} },
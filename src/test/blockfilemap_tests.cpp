@@ -0,0 +1,190 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <node/blockfilemap.h>
+#include <streams.h>
+#include <test/test_bitcoin.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, BasicTestingSetup)
+
+static void AppendToFile(const fs::path& path, const std::vector<unsigned char>& data)
+{
+    FILE* file = fsbridge::fopen(path, "ab");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_remap_and_evict)
+{
+    if (!BlockFileMap::IsSupported()) return;
+
+    const fs::path dir = SetDataDir("blockfilemap_remap_and_evict");
+    BlockFileMap map(2);
+
+    // Missing and empty files cannot be mapped.
+    BOOST_CHECK(!map.Get(0, dir / "file0", 1));
+    AppendToFile(dir / "file0", {});
+    BOOST_CHECK(!map.Get(0, dir / "file0", 0));
+
+    const std::vector<unsigned char> first{1, 2, 3, 4};
+    AppendToFile(dir / "file0", first);
+    std::shared_ptr<const MappedFile> mapping = map.Get(0, dir / "file0", 4);
+    BOOST_REQUIRE(mapping);
+    BOOST_CHECK_EQUAL(mapping->size(), 4U);
+    BOOST_CHECK(mapping->GetSpan() == MakeSpan(first));
+    // The same mapping serves reads within it.
+    BOOST_CHECK_EQUAL(map.Get(0, dir / "file0", 2), mapping);
+    // A read past its end cannot be served until the file grows.
+    BOOST_CHECK(!map.Get(0, dir / "file0", 8));
+
+    AppendToFile(dir / "file0", {5, 6, 7, 8});
+    std::shared_ptr<const MappedFile> grown = map.Get(0, dir / "file0", 8);
+    BOOST_REQUIRE(grown);
+    BOOST_CHECK_EQUAL(grown->size(), 8U);
+    BOOST_CHECK_EQUAL(grown->GetSpan()[7], 8);
+    // The old mapping stays valid for the readers still holding it.
+    BOOST_CHECK(mapping->GetSpan() == MakeSpan(first));
+
+    // Only the two most recently used files are kept.
+    AppendToFile(dir / "file1", first);
+    AppendToFile(dir / "file2", first);
+    std::shared_ptr<const MappedFile> file1 = map.Get(1, dir / "file1", 4);
+    BOOST_CHECK_EQUAL(map.Get(0, dir / "file0", 8), grown);
+    BOOST_CHECK(map.Get(2, dir / "file2", 4));
+    BOOST_CHECK_EQUAL(map.Get(0, dir / "file0", 8), grown);
+    BOOST_CHECK(map.Get(1, dir / "file1", 4) != file1);
+
+    // A different path for the same file number is mapped anew.
+    BOOST_CHECK(map.Get(0, dir / "file1", 4) != grown);
+
+    map.Drop(0);
+    BOOST_CHECK(map.Get(0, dir / "file0", 8) != grown);
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilemap_read_blocks, TestChain100Setup)
+{
+    std::vector<const CBlockIndex*> block_indexes;
+    {
+        LOCK(cs_main);
+        for (int height = 0; height <= chainActive.Height(); ++height) {
+            block_indexes.push_back(chainActive[height]);
+        }
+    }
+
+    // Blocks read through the mappings match the ones read from the files.
+    for (const CBlockIndex* pindex : block_indexes) {
+        CBlock mapped_block, file_block;
+        std::vector<uint8_t> mapped_raw, file_raw;
+
+        fMapBlockFiles = true;
+        BOOST_CHECK(ReadBlockFromDisk(mapped_block, pindex, Params().GetConsensus()));
+        BOOST_CHECK(ReadRawBlockFromDisk(mapped_raw, pindex, Params().MessageStart()));
+        fMapBlockFiles = false;
+        BOOST_CHECK(ReadBlockFromDisk(file_block, pindex, Params().GetConsensus()));
+        BOOST_CHECK(ReadRawBlockFromDisk(file_raw, pindex, Params().MessageStart()));
+
+        BOOST_CHECK_EQUAL(mapped_block.GetHash(), pindex->GetBlockHash());
+        BOOST_CHECK_EQUAL(mapped_block.vtx.size(), file_block.vtx.size());
+        BOOST_CHECK(mapped_raw == file_raw);
+
+        CDataStream serialized(SER_NETWORK, PROTOCOL_VERSION);
+        serialized << file_block;
+        BOOST_CHECK(std::vector<uint8_t>(serialized.begin(), serialized.end()) == mapped_raw);
+    }
+    fMapBlockFiles = DEFAULT_MAP_BLOCK_FILES;
+
+    // A block appended after its file was mapped is still found.
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    const CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, tip, Params().GetConsensus()));
+    BOOST_CHECK_EQUAL(block.GetHash(), tip->GetBlockHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(raw_block_without_witness, TestChain100Setup)
+{
+    // Segwit is not active on the test chain, so add a block with witness data
+    // to a block file of its own, in the layout WriteBlockToDisk uses.
+    CBlock witness_block;
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(ReadBlockFromDisk(witness_block, chainActive.Tip(), Params().GetConsensus()));
+    }
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(2);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vin[0].scriptWitness.stack = {{}, std::vector<unsigned char>(300, 1)};
+    spend.vin[1].prevout = COutPoint(m_coinbase_txns[1]->GetHash(), 0);
+    spend.vin[1].scriptSig = CScript() << OP_TRUE;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 10 * CENT;
+    spend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    witness_block.vtx.push_back(MakeTransactionRef(spend));
+    spend.vin[0].scriptWitness.SetNull();
+    witness_block.vtx.push_back(MakeTransactionRef(spend));
+
+    const CDiskBlockPos witness_pos(1000, 8);
+    {
+        CAutoFile file(OpenBlockFile(CDiskBlockPos(witness_pos.nFile, 0)), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!file.IsNull());
+        file << Params().MessageStart() << (unsigned int)GetSerializeSize(witness_block, PROTOCOL_VERSION);
+        file << witness_block;
+    }
+
+    std::vector<CDiskBlockPos> positions{witness_pos};
+    {
+        LOCK(cs_main);
+        for (int height = 1; height <= chainActive.Height(); ++height) {
+            positions.push_back(chainActive[height]->GetBlockPos());
+        }
+    }
+
+    // Both through the mappings and from the files, the stripped raw block is
+    // what serving the deserialized block to a peer without segwit would send.
+    for (const bool map_block_files : {true, false}) {
+        fMapBlockFiles = map_block_files;
+        for (const CDiskBlockPos& pos : positions) {
+            CBlock block;
+            BOOST_REQUIRE(ReadBlockFromDisk(block, pos, Params().GetConsensus(), false));
+
+            std::vector<uint8_t> raw, stripped;
+            BOOST_REQUIRE(ReadRawBlockFromDisk(raw, pos, Params().MessageStart()));
+            BOOST_REQUIRE(ReadRawBlockFromDisk(stripped, pos, Params().MessageStart(), false));
+            const bool has_witness = std::any_of(block.vtx.begin(), block.vtx.end(), [](const CTransactionRef& tx) { return tx->HasWitness(); });
+            BOOST_CHECK_EQUAL(has_witness, pos == witness_pos);
+            BOOST_CHECK_EQUAL(stripped.size() < raw.size(), has_witness);
+
+            CDataStream with_witness(SER_NETWORK, PROTOCOL_VERSION);
+            with_witness << block;
+            BOOST_CHECK(std::vector<uint8_t>(with_witness.begin(), with_witness.end()) == raw);
+            CDataStream without_witness(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+            without_witness << block;
+            BOOST_CHECK(std::vector<uint8_t>(without_witness.begin(), without_witness.end()) == stripped);
+        }
+    }
+    fMapBlockFiles = DEFAULT_MAP_BLOCK_FILES;
+
+    // A block read at the position of another one does not match its index.
+    CBlockIndex other;
+    {
+        LOCK(cs_main);
+        other = *chainActive.Tip();
+        other.nFile = chainActive[1]->nFile;
+        other.nDataPos = chainActive[1]->nDataPos;
+    }
+    std::vector<uint8_t> raw;
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, &other, Params().MessageStart(), false));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
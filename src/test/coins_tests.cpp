@@ -7,6 +7,7 @@
 #include <consensus/validation.h>
 #include <script/standard.h>
 #include <test/test_bitcoin.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <util/strencodings.h>
@@ -858,4 +859,83 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+
+BOOST_AUTO_TEST_CASE(ccoins_cache_coin)
+{
+    CCoinsView root;
+    CCoinsViewCacheTest base(&root);
+    CCoinsViewCacheTest cache(&base);
+
+    COutPoint outpoint(InsecureRand256(), 0);
+    base.AddCoin(outpoint, Coin(CTxOut(1, CScript() << OP_TRUE), 1, false), false);
+
+    // A prefetched coin is cached clean, as if it had been looked up.
+    Coin coin;
+    BOOST_CHECK(cache.GetBackend()->GetCoin(outpoint, coin));
+    cache.CacheCoin(outpoint, std::move(coin));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    BOOST_CHECK_EQUAL(cache.map().at(outpoint).flags, 0);
+    cache.SelfTest();
+
+    // It never replaces what the cache already knows.
+    BOOST_CHECK(cache.SpendCoin(outpoint));
+    cache.CacheCoin(outpoint, Coin(CTxOut(1, CScript() << OP_TRUE), 1, false));
+    BOOST_CHECK(!cache.HaveCoin(outpoint));
+    cache.SelfTest();
+
+    // Coins that were not found are not cached.
+    COutPoint missing(InsecureRand256(), 0);
+    cache.CacheCoin(missing, Coin());
+    BOOST_CHECK(!cache.HaveCoinInCache(missing));
+    BOOST_CHECK(cache.map().find(missing) == cache.map().end());
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_background_flush)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewDBFlusher flusher(&db);
+    CCoinsViewCache cache(&flusher);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 100; i++) {
+        outpoints.emplace_back(InsecureRand256(), InsecureRandBits(4));
+        cache.AddCoin(outpoints.back(), Coin(CTxOut(i + 1, CScript() << i), i, false), false);
+    }
+    uint256 hash1 = InsecureRand256();
+    cache.SetBestBlock(hash1);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+
+    // Whether or not the write has completed, the flushed coins are visible.
+    {
+        CCoinsViewCache view(&flusher);
+        BOOST_CHECK(view.GetBestBlock() == hash1);
+        for (size_t i = 0; i < outpoints.size(); i++) {
+            BOOST_CHECK_EQUAL(view.AccessCoin(outpoints[i]).out.nValue, (CAmount)i + 1);
+        }
+    }
+
+    // Spend half of them; the next flush waits for the previous one.
+    for (size_t i = 0; i < outpoints.size(); i += 2) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+    }
+    uint256 hash2 = InsecureRand256();
+    cache.SetBestBlock(hash2);
+    BOOST_CHECK(cache.Flush());
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        BOOST_CHECK_EQUAL(flusher.HaveCoin(outpoints[i]), i % 2 == 1);
+    }
+    BOOST_CHECK(flusher.GetBestBlock() == hash2);
+
+    // Once synced, the database holds the same state and is marked consistent.
+    BOOST_CHECK(flusher.Sync());
+    BOOST_CHECK(!flusher.HasFailed());
+    BOOST_CHECK(db.GetBestBlock() == hash2);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        Coin coin;
+        BOOST_CHECK_EQUAL(db.GetCoin(outpoints[i], coin), i % 2 == 1);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,134 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/coinstatsindex.h>
+#include <node/coinstats.h>
+#include <script/interpreter.h>
+#include <test/test_bitcoin.h>
+#include <txdb.h>
+#include <txmempool.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(coinstatsindex_tests)
+
+static void CheckIndexMatchesUTXOSet(CoinStatsIndex& index)
+{
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+
+    CCoinsStats expected;
+    FlushStateToDisk();
+    BOOST_REQUIRE(GetUTXOStats(pcoinsdbview.get(), expected, CoinStatsHashType::MUHASH));
+
+    const CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+    CCoinsStats stats;
+    BOOST_REQUIRE(index.LookUpStats(tip, stats));
+    BOOST_CHECK_EQUAL(stats.nHeight, expected.nHeight);
+    BOOST_CHECK_EQUAL(stats.hashBlock, expected.hashBlock);
+    BOOST_CHECK_EQUAL(stats.hashSerialized, expected.hashSerialized);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, expected.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, expected.nBogoSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, expected.nTotalAmount);
+}
+
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup)
+{
+    CoinStatsIndex coin_stats_index(1 << 20, true);
+
+    const CBlockIndex* block_index;
+    {
+        LOCK(cs_main);
+        block_index = chainActive.Tip();
+    }
+
+    // Nothing is found before the index is started.
+    CCoinsStats coin_stats;
+    BOOST_CHECK(!coin_stats_index.LookUpStats(block_index, coin_stats));
+
+    // BlockUntilSyncedToCurrentChain should return false before the index is started.
+    BOOST_CHECK(!coin_stats_index.BlockUntilSyncedToCurrentChain());
+
+    coin_stats_index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!coin_stats_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // Every block of the chain has its entry; the genesis block adds no coins.
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(coin_stats_index.LookUpStats(chainActive.Genesis(), coin_stats));
+        BOOST_CHECK_EQUAL(coin_stats.nTransactionOutputs, 0U);
+        BOOST_CHECK(coin_stats_index.LookUpStats(chainActive[10], coin_stats));
+        BOOST_CHECK_EQUAL(coin_stats.nHeight, 10);
+    }
+    CheckIndexMatchesUTXOSet(coin_stats_index);
+
+    // A block spending a coinbase output.
+    CScript script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = script_pub_key;
+    spend.vout[1].nValue = 0;
+    spend.vout[1].scriptPubKey = CScript() << OP_RETURN;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(script_pub_key, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, script_pub_key);
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE_EQUAL(chainActive.Tip()->GetBlockHash(), block.GetHash());
+    }
+    CheckIndexMatchesUTXOSet(coin_stats_index);
+
+    // A reorg replacing that block: the index rewinds using the undo data.
+    CBlockIndex* stale_index;
+    {
+        LOCK(cs_main);
+        stale_index = chainActive.Tip();
+    }
+    CValidationState state;
+    BOOST_CHECK(InvalidateBlock(state, Params(), stale_index));
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    // The spend is back in the mempool, where its fee would go to the template's coinbase.
+    mempool.clear();
+    for (int i = 0; i < 2; i++) {
+        CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    }
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE_EQUAL(chainActive.Height(), stale_index->nHeight + 1);
+    }
+    CheckIndexMatchesUTXOSet(coin_stats_index);
+    BOOST_CHECK(!coin_stats_index.LookUpStats(stale_index, coin_stats));
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    coin_stats_index.Stop();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,7 +10,10 @@
 #include <crypto/sha512.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
+#include <crypto/muhash.h>
+#include <crypto/neoscrypt.h>
 #include <random.h>
+#include <streams.h>
 #include <util/strencodings.h>
 #include <test/test_bitcoin.h>
 
@@ -562,4 +565,129 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(neoscrypt_multi_matches_reference)
+{
+    for (unsigned int profile : {0x0, 0x3}) {
+        for (int i = 0; i <= 17; ++i) {
+            unsigned char in[80 * 17];
+            unsigned char out1[32 * 17], out2[32 * 17];
+            for (int j = 0; j < 80 * i; ++j) {
+                in[j] = InsecureRandBits(8);
+            }
+            for (int j = 0; j < i; ++j) {
+                neoscrypt(in + 80 * j, out1 + 32 * j, profile);
+            }
+            neoscrypt_multi(in, out2, i, profile);
+            BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(neoscrypt_ctx_tests)
+{
+    static const std::pair<unsigned int, const char*> vectors[] = {
+        {0x0, "7258961afb33fd12d00cacb8d63f4f4f52bb6917043865dd24a08f578853122d"},
+        {0x3, "bc540a1a801df96e493005c71e010e2d387607fbf0fec416fd3c2645aa1ba9d2"},
+        {0x80000000 | (3 << 8) | (1 << 5), "20ddbfb5c9ec4f6c1dd6803a8e33fec881e83090ace575cb1e7a96712afef827"},
+    };
+    unsigned char in[80];
+    unsigned char out[32];
+    for (int i = 0; i < 80; ++i) {
+        in[i] = i;
+    }
+
+    neoscrypt_ctx ctx;
+    neoscrypt_ctx_init(&ctx);
+    // The same context serves every profile, whether its scratchpad grows or not
+    for (int round = 0; round < 2; ++round) {
+        for (const auto& vector : vectors) {
+            BOOST_CHECK_EQUAL(neoscrypt_ctx_hash(&ctx, in, out, vector.first), 0);
+            BOOST_CHECK_EQUAL(HexStr(out, out + 32), vector.second);
+            neoscrypt(in, out, vector.first);
+            BOOST_CHECK_EQUAL(HexStr(out, out + 32), vector.second);
+        }
+    }
+    BOOST_CHECK_EQUAL((size_t)ctx.scratch % 64, 0U);
+    // N = 2^32 is not a valid extended profile
+    BOOST_CHECK_EQUAL(neoscrypt_ctx_hash(&ctx, in, out, 0x80000000 | (0x1F << 8)), -1);
+    neoscrypt_ctx_free(&ctx);
+    BOOST_CHECK(ctx.buffer == nullptr);
+}
+
+static MuHash3072 FromInt(unsigned char i) {
+    const unsigned char tmp[32] = {i, 0};
+    return MuHash3072(MakeSpan(tmp));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    uint256 out;
+
+    for (int iter = 0; iter < 10; ++iter) {
+        // The result does not depend on the order of insertions and removals
+        uint256 res;
+        int table[4];
+        for (int i = 0; i < 4; ++i) {
+            table[i] = InsecureRandBits(3);
+        }
+        for (int order = 0; order < 4; ++order) {
+            MuHash3072 acc;
+            for (int i = 0; i < 4; ++i) {
+                int t = table[i ^ order];
+                if (t & 4) {
+                    acc /= FromInt(t & 3);
+                } else {
+                    acc *= FromInt(t & 3);
+                }
+            }
+            acc.Finalize(out);
+            if (order == 0) {
+                res = out;
+            } else {
+                BOOST_CHECK(res == out);
+            }
+        }
+
+        // Removing what was inserted gives the empty set
+        MuHash3072 x = FromInt(InsecureRandBits(4));
+        MuHash3072 y = FromInt(InsecureRandBits(4));
+        uint256 out2;
+        x.Finalize(out);
+        x *= y;
+        x /= y;
+        x.Finalize(out2);
+        BOOST_CHECK(out == out2);
+        y /= y;
+        y.Finalize(out);
+        MuHash3072().Finalize(out2);
+        BOOST_CHECK(out == out2);
+    }
+
+    MuHash3072 acc = FromInt(0);
+    acc *= FromInt(1);
+    acc /= FromInt(2);
+    acc.Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+
+    MuHash3072 acc2 = FromInt(0);
+    const unsigned char tmp[32] = {1, 0};
+    acc2.Insert(MakeSpan(tmp));
+    const unsigned char tmp2[32] = {2, 0};
+    acc2.Remove(MakeSpan(tmp2));
+    acc2.Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+
+    // The state survives a serialization round trip, and keeps both numerator and denominator
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    MuHash3072 acc3 = FromInt(0);
+    acc3.Remove(MakeSpan(tmp2));
+    ss << acc3;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 acc4;
+    ss >> acc4;
+    acc4.Insert(MakeSpan(tmp));
+    acc4.Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -119,6 +119,51 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+// Test that every profile gives a working database that is listed in the stats.
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    for (const DBProfile profile : {DBProfile::DEFAULT, DBProfile::CHAINSTATE, DBProfile::BLOCK_TREE, DBProfile::INDEX}) {
+        fs::path ph = SetDataDir(std::string("dbwrapper_profiles_").append(DBProfileName(profile)));
+        std::unique_ptr<CDBWrapper> dbw = MakeUnique<CDBWrapper>(ph, (1 << 20), false, false, true, profile);
+
+        CDBBatch batch(*dbw);
+        for (unsigned int i = 0; i < 1000; ++i) {
+            batch.Write(i, InsecureRand256());
+        }
+        BOOST_CHECK(dbw->WriteBatch(batch));
+        uint256 in = InsecureRand256();
+        uint256 res;
+        BOOST_CHECK(dbw->Write('k', in));
+        BOOST_CHECK(dbw->Read('k', res));
+        BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+        // A compaction moves the data into table files, so blocks and
+        // filters are exercised on the way back.
+        dbw->CompactRange(0U, 1000U);
+        BOOST_CHECK(dbw->Read(500U, res));
+
+        int found = 0;
+        for (const DBStats& stats : GetDBStats()) {
+            if (stats.path != ph.string()) continue;
+            ++found;
+            BOOST_CHECK_EQUAL(stats.profile, DBProfileName(profile));
+            BOOST_CHECK_EQUAL(stats.block_cache_size + 2 * stats.write_buffer_size <= (1 << 20), true);
+            BOOST_CHECK(stats.block_size > 0);
+            BOOST_CHECK(stats.max_file_size > 0);
+            // Nothing is compressed without Snappy
+            BOOST_CHECK(!stats.compression);
+            BOOST_CHECK(stats.memory_usage > 0);
+            BOOST_CHECK(stats.leveldb_stats.find("Compactions") != std::string::npos);
+        }
+        BOOST_CHECK_EQUAL(found, 1);
+
+        // A closed database is no longer listed.
+        dbw.reset();
+        for (const DBStats& stats : GetDBStats()) {
+            BOOST_CHECK(stats.path != ph.string());
+        }
+    }
+}
+
 // Test that we do not obfuscation if there is existing data.
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
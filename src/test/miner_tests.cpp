@@ -11,6 +11,7 @@
 #include <validation.h>
 #include <miner.h>
 #include <policy/policy.h>
+#include <pow.h>
 #include <pubkey.h>
 #include <script/standard.h>
 #include <txmempool.h>
@@ -521,4 +522,43 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_AUTO_TEST_CASE(ScanNonces_test)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& consensus = chainParams->GetConsensus();
+    CBlockHeader genesis = chainParams->GenesisBlock();
+    genesis.nNonce = 0;
+
+    // A single thread finds the lowest valid nonce
+    CBlockHeader block = genesis;
+    uint64_t nMaxTries = 1000;
+    BOOST_CHECK(ScanNonces(block, 0x10000, 1, nMaxTries, consensus));
+    BOOST_CHECK(CheckProofOfWork(block.GetPoWHash(GetPoWProfile(block, consensus)), block.nBits, consensus));
+    BOOST_CHECK(nMaxTries < 1000);
+    for (CBlockHeader lower = genesis; lower.nNonce < block.nNonce; ++lower.nNonce) {
+        BOOST_CHECK(!CheckProofOfWork(lower.GetPoWHash(GetPoWProfile(lower, consensus)), lower.nBits, consensus));
+    }
+
+    // Several threads find some valid nonce
+    block = genesis;
+    nMaxTries = 1000;
+    BOOST_CHECK(ScanNonces(block, 0x10000, 4, nMaxTries, consensus));
+    BOOST_CHECK(CheckProofOfWork(block.GetPoWHash(GetPoWProfile(block, consensus)), block.nBits, consensus));
+
+    // Out of tries
+    CBlockHeader hard = genesis;
+    hard.nBits = 0x1d00ffff;
+    block = hard;
+    nMaxTries = 20;
+    BOOST_CHECK(!ScanNonces(block, 0x10000, 4, nMaxTries, consensus));
+    BOOST_CHECK_EQUAL(nMaxTries, 0U);
+
+    // Out of nonces
+    block = hard;
+    nMaxTries = 1000;
+    BOOST_CHECK(!ScanNonces(block, 10, 2, nMaxTries, consensus));
+    BOOST_CHECK_EQUAL(block.nNonce, 10U);
+    BOOST_CHECK_EQUAL(nMaxTries, 990U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
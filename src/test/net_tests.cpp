@@ -13,7 +13,13 @@
 #include <chainparams.h>
 #include <util/system.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
 
 class CAddrManSerializationMock : public CAddrMan
 {
@@ -73,6 +79,49 @@ static CDataStream AddrmanToStream(CAddrManSerializationMock& _addrman)
     return CDataStream(vchData, SER_DISK, CLIENT_VERSION);
 }
 
+/** Stands in for PeerLogicValidation: each peer's "messages" are numbers, processed one per call */
+class MessageOrderRecorder : public NetEventsInterface
+{
+public:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::map<NodeId, std::deque<int>> m_pending;
+    std::map<NodeId, std::vector<int>> m_processed;
+    //! Peers currently in ProcessMessages()
+    std::set<NodeId> m_busy;
+    bool m_peer_reentered{false};
+    bool m_peers_together{false};
+
+    bool ProcessMessages(CNode* pnode, std::atomic<bool>& interrupt) override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const NodeId id = pnode->GetId();
+        if (!m_busy.insert(id).second) m_peer_reentered = true;
+        m_cond.notify_all();
+        if (m_processed[id].empty()) {
+            // Only returns early if another thread is in ProcessMessages() for the other peer
+            if (m_cond.wait_for(lock, std::chrono::seconds(10), [this] { return m_busy.size() == 2; })) {
+                m_peers_together = true;
+            }
+        }
+        if (!m_pending[id].empty()) {
+            const int message = m_pending[id].front();
+            m_pending[id].pop_front();
+            // Let the other thread run in the middle of processing a message
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+            m_processed[id].push_back(message);
+        }
+        m_busy.erase(id);
+        m_cond.notify_all();
+        return !m_pending[id].empty();
+    }
+    bool SendMessages(CNode* pnode) override { return true; }
+    void InitializeNode(CNode* pnode) override {}
+    void FinalizeNode(NodeId id, bool& update_connection_time) override {}
+};
+
 BOOST_FIXTURE_TEST_SUITE(net_tests, BasicTestingSetup)
 
 BOOST_AUTO_TEST_CASE(cnode_listen_port)
@@ -189,7 +238,80 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(cnetmessage_read_in_chunks)
+{
+    const CMessageHeader::MessageStartChars& pchMessageStart = Params().MessageStart();
+
+    // Messages from empty to several times the 256 KiB read-ahead, so the
+    // largest outgrows its receive buffer a few times
+    for (size_t nSize : {0, 1, 200, 70000, 1500000}) {
+        std::vector<unsigned char> payload(nSize);
+        for (size_t i = 0; i < nSize; i++) payload[i] = InsecureRandBits(8);
+        CMessageHeader hdr(pchMessageStart, NetMsgType::BLOCK, nSize);
+        uint256 hash = Hash(payload.begin(), payload.end());
+        memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+        CDataStream wire(SER_NETWORK, PROTOCOL_VERSION);
+        wire << hdr;
+        wire.write((const char*)payload.data(), payload.size());
+
+        CNetMessage msg(pchMessageStart, SER_NETWORK, PROTOCOL_VERSION);
+        const char* pch = wire.data();
+        size_t nRemaining = wire.size();
+        while (nRemaining > 0) {
+            unsigned int nBytes = std::min<size_t>(nRemaining, 1 + InsecureRandRange(0x10000));
+            int handled = msg.in_data ? msg.readData(pch, nBytes) : msg.readHeader(pch, nBytes);
+            BOOST_REQUIRE(handled > 0);
+            pch += handled;
+            nRemaining -= handled;
+        }
+        BOOST_REQUIRE(msg.complete());
+        BOOST_CHECK(msg.GetMessageHash() == hash);
+        BOOST_CHECK_EQUAL(msg.vRecv.size(), nSize);
+        BOOST_CHECK(std::equal(msg.vRecv.begin(), msg.vRecv.end(), (const char*)payload.data()));
+    }
+}
+
 // prior to PR #14728, this test triggers an undefined behavior
+BOOST_AUTO_TEST_CASE(msghand_threads_keep_peer_order)
+{
+    MessageOrderRecorder recorder;
+    const int nMessages = 200;
+    auto connman = MakeUnique<CConnmanTest>(0x1337, 0x1337);
+    for (NodeId id = 0; id < 2; id++) {
+        in_addr ipv4Addr;
+        ipv4Addr.s_addr = 0xa0b0c001 + id;
+        CNode* pnode = new CNode(id, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(CService(ipv4Addr, 7777), NODE_NETWORK), 0, 0, CAddress(), "", true);
+        for (int i = 0; i < nMessages; i++) {
+            recorder.m_pending[id].push_back(i);
+        }
+        connman->AddNode(*pnode);
+    }
+
+    CConnman::Options options;
+    options.m_msgproc = &recorder;
+    options.m_msghand_threads = 2;
+    connman->StartMessageHandlers(options);
+    {
+        std::unique_lock<std::mutex> lock(recorder.m_mutex);
+        BOOST_CHECK(recorder.m_cond.wait_for(lock, std::chrono::seconds(60), [&recorder] {
+            return recorder.m_busy.empty() && recorder.m_pending[0].empty() && recorder.m_pending[1].empty();
+        }));
+    }
+    connman->Interrupt();
+    connman->Stop();
+
+    // Both peers were worked on at the same time, by different threads
+    BOOST_CHECK(recorder.m_peers_together);
+    // but each peer's messages by one thread at a time, in order
+    BOOST_CHECK(!recorder.m_peer_reentered);
+    for (NodeId id = 0; id < 2; id++) {
+        BOOST_REQUIRE_EQUAL(recorder.m_processed[id].size(), (size_t)nMessages);
+        for (int i = 0; i < nMessages; i++) {
+            BOOST_CHECK_EQUAL(recorder.m_processed[id][i], i);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(ipv4_peer_with_ipv6_addrMe_test)
 {
     // set up local addresses; all that's necessary to reproduce the bug is
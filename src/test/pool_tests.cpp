@@ -0,0 +1,98 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <memusage.h>
+#include <support/allocators/pool.h>
+#include <test/test_bitcoin.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(basic_allocate_deallocate)
+{
+    PoolResource<8, 8> resource(64);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+    // Freed blocks are handed out again.
+    void* block = resource.Allocate(8, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    resource.Deallocate(block, 8, 8);
+    BOOST_CHECK(resource.Allocate(8, 8) == block);
+
+    // A chunk holds 8 blocks.
+    std::vector<void*> blocks{block};
+    for (int i = 0; i < 7; i++) {
+        blocks.push_back(resource.Allocate(8, 8));
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    blocks.push_back(resource.Allocate(1, 1));
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+
+    // Too large or too strictly aligned allocations bypass the pool.
+    void* large = resource.Allocate(16, 8);
+    void* aligned = resource.Allocate(8, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    resource.Deallocate(large, 16, 8);
+    resource.Deallocate(aligned, 8, 16);
+
+    for (void* p : blocks) {
+        resource.Deallocate(p, 8, 8);
+    }
+    for (size_t i = 0; i < blocks.size(); i++) {
+        resource.Allocate(8, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(remainder_of_chunk_is_reused)
+{
+    // 24 byte blocks leave 16 bytes unused at the end of a 64 byte chunk.
+    PoolResource<24, 8> resource(64);
+    void* a = resource.Allocate(24, 8);
+    resource.Allocate(24, 8);
+    resource.Allocate(24, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    void* b = resource.Allocate(16, 8);
+    BOOST_CHECK_EQUAL((char*)b - (char*)a, 48);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(unordered_map_with_pool)
+{
+    typedef std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                               PoolAllocator<std::pair<const uint64_t, uint64_t>, sizeof(std::pair<const uint64_t, uint64_t>) + sizeof(void*) * 4>> Map;
+    Map map;
+    for (uint64_t i = 0; i < 10000; i++) {
+        map[i] = i * 2;
+    }
+    const uint64_t* ref = &map.at(42);
+    const size_t usage = memusage::DynamicUsage(map);
+    BOOST_CHECK(usage >= map.get_allocator().resource()->ChunkSizeBytes());
+
+    // Erasing and reinserting reuses nodes: no new chunks, references to
+    // other entries stay valid.
+    for (uint64_t i = 0; i < 10000; i += 2) {
+        if (i != 42) map.erase(i);
+    }
+    for (uint64_t i = 0; i < 10000; i += 2) {
+        map[i] = i;
+    }
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), usage);
+    BOOST_CHECK(ref == &map.at(42));
+    BOOST_CHECK_EQUAL(map.at(43), 86U);
+
+    // A moved-to map shares the resource, which outlives the original.
+    Map* moved = new Map(std::move(map));
+    map = Map();
+    BOOST_CHECK(map.get_allocator() != moved->get_allocator());
+    BOOST_CHECK_EQUAL(moved->size(), 10000U);
+    BOOST_CHECK_EQUAL(moved->at(9999), 19998U);
+    delete moved;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,142 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <openssl/opensslv.h>
+
+// bignum.h needs the BIGNUM internals that OpenSSL 1.1 made opaque
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+
+#include <arith_uint256.h>
+#include <bignum.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <pow.h>
+#include <random.h>
+#include <test/test_bitcoin.h>
+
+#include <math.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pow_bignum_tests, BasicTestingSetup)
+
+/* GetNextWorkRequired_V2 as it was implemented with OpenSSL bignums */
+static unsigned int GetNextWorkRequired_V2_BigNum(const CBlockIndex* pindexLast, const Consensus::Params& params)
+{
+    CBigNum bnProofOfWorkLimit;
+    bnProofOfWorkLimit.SetCompact(504365055);
+    int64_t nTargetTimespan = 60 * 60;
+    int64_t PastSecondsMin = nTargetTimespan * 0.025;
+    if(pindexLast->nHeight + 1 >= params.nHardForkTwoA)
+        PastSecondsMin = nTargetTimespan * 0.15;
+    int64_t PastSecondsMax = nTargetTimespan * 7;
+    uint64_t PastBlocksMin = PastSecondsMin / params.nPowTargetSpacing;
+    uint64_t PastBlocksMax = PastSecondsMax / params.nPowTargetSpacing;
+    const CBlockIndex *BlockLastSolved = pindexLast;
+    const CBlockIndex *BlockReading = pindexLast;
+    uint64_t PastBlocksMass = 0;
+    int64_t PastRateActualSeconds = 0;
+    int64_t PastRateTargetSeconds = 0;
+    double PastRateAdjustmentRatio = double(1);
+    CBigNum PastDifficultyAverage;
+    CBigNum PastDifficultyAveragePrev;
+    double EventHorizonDeviation;
+    double EventHorizonDeviationFast;
+    double EventHorizonDeviationSlow;
+
+    if (BlockLastSolved == NULL || BlockLastSolved->nHeight == 0 || (uint64_t)BlockLastSolved->nHeight < PastBlocksMin)
+        return bnProofOfWorkLimit.GetCompact();
+
+    int64_t LatestBlockTime = BlockLastSolved->GetBlockTime();
+    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++)
+    {
+        if (PastBlocksMax > 0 && i > PastBlocksMax)
+            break;
+
+        PastBlocksMass++;
+
+        if (i == 1)
+            PastDifficultyAverage.SetCompact(BlockReading->nBits);
+        else
+            PastDifficultyAverage = ((CBigNum().SetCompact(BlockReading->nBits) - PastDifficultyAveragePrev) / i) + PastDifficultyAveragePrev;
+
+        PastDifficultyAveragePrev = PastDifficultyAverage;
+
+        if (LatestBlockTime < BlockReading->GetBlockTime())
+            LatestBlockTime = BlockReading->GetBlockTime();
+
+        PastRateActualSeconds = LatestBlockTime - BlockReading->GetBlockTime();
+        PastRateTargetSeconds = params.nPowTargetSpacing * PastBlocksMass;
+        PastRateAdjustmentRatio = double(1);
+
+        if (PastRateActualSeconds < 1)
+            PastRateActualSeconds = 5;
+
+        if (PastRateActualSeconds != 0 && PastRateTargetSeconds != 0)
+            PastRateAdjustmentRatio = double(PastRateTargetSeconds) / double(PastRateActualSeconds);
+
+        if(pindexLast->nHeight + 1 >= params.nHardForkTwoA)
+            EventHorizonDeviation = 1 + (0.7084 * pow((double(PastBlocksMass) / double(144)), -1.228));
+        else
+            EventHorizonDeviation = 1 + (0.7084 * pow((double(PastBlocksMass) / double(28.2)), -1.228));
+
+        EventHorizonDeviationFast = EventHorizonDeviation;
+        EventHorizonDeviationSlow = 1 / EventHorizonDeviation;
+
+        if (PastBlocksMass >= PastBlocksMin)
+        {
+            if ((PastRateAdjustmentRatio <= EventHorizonDeviationSlow) || (PastRateAdjustmentRatio >= EventHorizonDeviationFast))
+                break;
+        }
+
+        if (BlockReading->pprev == NULL)
+            break;
+        BlockReading = BlockReading->pprev;
+    }
+
+    CBigNum bnNew(PastDifficultyAverage);
+    if (PastRateActualSeconds != 0 && PastRateTargetSeconds != 0)
+    {
+        bnNew *= PastRateActualSeconds;
+        bnNew /= PastRateTargetSeconds;
+    }
+
+    if (bnNew > bnProofOfWorkLimit)
+        bnNew = bnProofOfWorkLimit;
+
+    return bnNew.GetCompact();
+}
+
+/* The native V2 retarget must match the bignum one bit for bit */
+BOOST_AUTO_TEST_CASE(retarget_v2_matches_bignum)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& consensus = chainParams->GetConsensus();
+    const int nBlocks = 700;
+    // Cover both sides of nHardForkTwoA
+    const int nFirstHeight = consensus.nHardForkTwoA - nBlocks / 2;
+
+    for (int round = 0; round < 8; round++) {
+        std::vector<CBlockIndex> blocks(nBlocks);
+        for (int i = 0; i < nBlocks; i++) {
+            blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+            blocks[i].nHeight = nFirstHeight + i;
+            // Mostly regular spacing, with blocks out of order and some long gaps
+            int64_t nSpacing = (int64_t)InsecureRandRange(400) - 100;
+            if (InsecureRandRange(50) == 0) nSpacing = InsecureRandRange(10000000);
+            blocks[i].nTime = i ? blocks[i - 1].nTime + nSpacing : 1400000000;
+            // Targets anywhere from the limit down to very hard ones, both rising and falling
+            arith_uint256 bnTarget = UintToArith256(InsecureRand256()) >> (20 + InsecureRandRange(round < 4 ? 8 : 200));
+            if (bnTarget == 0) bnTarget = 1;
+            blocks[i].nBits = bnTarget.GetCompact();
+        }
+        for (int i = 0; i < nBlocks; i++) {
+            BOOST_CHECK_EQUAL(GetNextWorkRequired_V2(&blocks[i], consensus), GetNextWorkRequired_V2_BigNum(&blocks[i], consensus));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif // OPENSSL_VERSION_NUMBER < 0x10100000L
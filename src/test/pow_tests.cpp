@@ -4,6 +4,7 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <hash.h>
 #include <pow.h>
 #include <random.h>
 #include <util/system.h>
@@ -83,4 +84,70 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+/* Retargeting must not depend on whether ancestors are found through the skip list */
+BOOST_AUTO_TEST_CASE(retarget_skiplist)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& consensus = chainParams->GetConsensus();
+    const int nBlocks = 3000;
+    std::vector<CBlockIndex> skip(nBlocks);
+    std::vector<CBlockIndex> linear(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        skip[i].pprev = i ? &skip[i - 1] : nullptr;
+        skip[i].nHeight = i;
+        skip[i].nTime = i ? skip[i - 1].nTime + InsecureRandRange(300) : 1388998800;
+        skip[i].nBits = 0x1e0fffff - InsecureRandRange(0x100);
+        skip[i].BuildSkip();
+
+        linear[i].pprev = i ? &linear[i - 1] : nullptr;
+        linear[i].nHeight = i;
+        linear[i].nTime = skip[i].nTime;
+        linear[i].nBits = skip[i].nBits;
+    }
+
+    CBlockHeader header;
+    for (int i = 1; i < nBlocks; i++) {
+        header.nTime = skip[i].nTime + 90;
+        BOOST_CHECK_EQUAL(GetNextWorkRequired_V1(&skip[i], &header, consensus), GetNextWorkRequired_V1(&linear[i], &header, consensus));
+        BOOST_CHECK_EQUAL(GetNextWorkRequired_V3(&skip[i], consensus), GetNextWorkRequired_V3(&linear[i], consensus));
+    }
+}
+
+/* Chains around nHardForkTwoA for the V2 retarget, mostly regular with blocks out of order, long gaps and wild targets */
+static std::vector<CBlockIndex> RetargetV2Chain(FastRandomContext& rng, const Consensus::Params& consensus, int round)
+{
+    const int nBlocks = 700;
+    // Cover both sides of nHardForkTwoA
+    const int nFirstHeight = consensus.nHardForkTwoA - nBlocks / 2;
+    std::vector<CBlockIndex> blocks(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = nFirstHeight + i;
+        int64_t nSpacing = (int64_t)rng.randrange(400) - 100;
+        if (rng.randrange(50) == 0) nSpacing = rng.randrange(10000000);
+        blocks[i].nTime = i ? blocks[i - 1].nTime + nSpacing : 1400000000;
+        arith_uint256 bnTarget = UintToArith256(rng.rand256()) >> (20 + rng.randrange(round < 4 ? 8 : 200));
+        if (bnTarget == 0) bnTarget = 1;
+        blocks[i].nBits = bnTarget.GetCompact();
+    }
+    return blocks;
+}
+
+/* The V2 retarget must keep giving what the OpenSSL bignum implementation it replaced did */
+BOOST_AUTO_TEST_CASE(retarget_v2_reference)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& consensus = chainParams->GetConsensus();
+    FastRandomContext rng(uint256S("ea5cd6b1e46a5a3b5bb34a3e4542a17b8cebb5f3f4b0a7d5bd2b1cf3b6a2ad21"));
+    CHashWriter hasher(SER_GETHASH, 0);
+    for (int round = 0; round < 8; round++) {
+        std::vector<CBlockIndex> blocks = RetargetV2Chain(rng, consensus, round);
+        for (const CBlockIndex& block : blocks) {
+            hasher << GetNextWorkRequired_V2(&block, consensus);
+        }
+    }
+    // Digest of the bignum implementation's results, see pow_bignum_tests.cpp
+    BOOST_CHECK_EQUAL(hasher.GetHash().GetHex(), "d045f4b5d9f23c374ee32fb7293da1ab74890832d5ff8974712383d224ff863f");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,67 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <pow.h>
+#include <powcache.h>
+#include <script/script.h>
+#include <validation.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(powcache_tests)
+
+BOOST_FIXTURE_TEST_CASE(pow_cache, BasicTestingSetup)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& consensus = chainParams->GetConsensus();
+    CBlockHeader valid = chainParams->GenesisBlock();
+    valid.nTime += 1;
+    while (!CheckProofOfWork(valid.GetPoWHash(GetPoWProfile(valid, consensus)), valid.nBits, consensus)) {
+        ++valid.nNonce;
+    }
+    CBlockHeader invalid = valid;
+    do {
+        ++invalid.nNonce;
+    } while (CheckProofOfWork(invalid.GetPoWHash(GetPoWProfile(invalid, consensus)), invalid.nBits, consensus));
+
+    PoWCacheStats before = GetPoWCacheStats();
+
+    // An invalid proof of work is never cached
+    BOOST_CHECK(!CheckProofOfWorkCached(invalid, consensus));
+    BOOST_CHECK(!CheckProofOfWorkCached(invalid, consensus));
+    BOOST_CHECK(!IsPoWCached(invalid.GetHash()));
+
+    // A valid one is only hashed the first time
+    BOOST_CHECK(CheckProofOfWorkCached(valid, consensus));
+    BOOST_CHECK(CheckProofOfWorkCached(valid, consensus));
+    BOOST_CHECK(IsPoWCached(valid.GetHash()));
+
+    PoWCacheStats after = GetPoWCacheStats();
+    BOOST_CHECK_EQUAL(after.hits - before.hits, 2U);
+    BOOST_CHECK_EQUAL(after.misses - before.misses, 4U);
+}
+
+BOOST_FIXTURE_TEST_CASE(pow_cache_persist, TestChain100Setup)
+{
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(IsPoWCached(chainActive.Tip()->GetBlockHash()));
+    }
+
+    // The file is used at the tip it was saved at
+    BOOST_CHECK(DumpPoWCache());
+    BOOST_CHECK(LoadPoWCache());
+
+    // and ignored once the tip has moved on
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    BOOST_CHECK(!LoadPoWCache());
+
+    BOOST_CHECK(DumpPoWCache());
+    BOOST_CHECK(LoadPoWCache());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include <chainparamsbase.h>
 #include <fs.h>
 #include <key.h>
+#include <net.h>
 #include <pubkey.h>
 #include <random.h>
 #include <scheduler.h>
@@ -105,6 +106,30 @@ struct TestChain100Setup : public TestingSetup {
     CKey coinbaseKey; // private/public key needed to spend coinbase transactions
 };
 
+struct CConnmanTest : public CConnman {
+    using CConnman::CConnman;
+    void AddNode(CNode& node)
+    {
+        LOCK(cs_vNodes);
+        vNodes.push_back(&node);
+    }
+    void ClearNodes()
+    {
+        LOCK(cs_vNodes);
+        for (CNode* node : vNodes) {
+            delete node;
+        }
+        vNodes.clear();
+    }
+    //! Run only the message handler threads, without sockets or addrman
+    void StartMessageHandlers(const Options& options)
+    {
+        Init(options);
+        flagInterruptMsgProc = false;
+        CConnman::StartMessageHandlers();
+    }
+};
+
 class CTxMemPoolEntry;
 
 struct TestMemPoolEntryHelper
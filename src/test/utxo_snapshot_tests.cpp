@@ -0,0 +1,104 @@
+// Copyright (c) 2021 The UFO Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <node/coinstats.h>
+#include <node/utxo_snapshot.h>
+#include <streams.h>
+#include <txdb.h>
+#include <validation.h>
+#include <test/test_bitcoin.h>
+
+#include <memory>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxo_snapshot_tests, TestChain100Setup)
+
+static fs::path WriteSnapshot(const std::string& name, SnapshotMetadata& metadata, CCoinsStats& stats)
+{
+    FlushStateToDisk();
+    const fs::path path = GetDataDir() / name;
+    CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    BOOST_CHECK(WriteUTXOSnapshot(*pcursor, file, metadata, stats));
+    return path;
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_roundtrip)
+{
+    SnapshotMetadata metadata(Params().MessageStart(), uint256(), 0);
+    CCoinsStats stats;
+    const fs::path path = WriteSnapshot("utxo.dat", metadata, stats);
+
+    CCoinsStats expected;
+    BOOST_CHECK(GetUTXOStats(pcoinsdbview.get(), expected));
+    BOOST_CHECK_EQUAL(metadata.m_base_blockhash, chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(metadata.m_coins_count, expected.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.hashSerialized, expected.hashSerialized);
+
+    // Load it into an empty database, in many small batches
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    SnapshotMetadata metadataRead;
+    file >> metadataRead;
+    BOOST_CHECK_EQUAL(metadataRead.m_base_blockhash, metadata.m_base_blockhash);
+    BOOST_CHECK_EQUAL(metadataRead.m_coins_count, metadata.m_coins_count);
+
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsStats statsRead;
+    BOOST_CHECK(ReadUTXOSnapshot(file, metadataRead, statsRead, &db, 1024));
+    BOOST_CHECK_EQUAL(statsRead.hashSerialized, expected.hashSerialized);
+    BOOST_CHECK_EQUAL(statsRead.nTotalAmount, expected.nTotalAmount);
+
+    // The database only becomes consistent with the base block once flushed
+    BOOST_CHECK(db.GetBestBlock().IsNull());
+    CCoinsMap empty;
+    BOOST_CHECK(db.BatchWrite(empty, metadata.m_base_blockhash));
+    CCoinsStats statsLoaded;
+    BOOST_CHECK(GetUTXOStats(&db, statsLoaded));
+    BOOST_CHECK_EQUAL(statsLoaded.hashSerialized, expected.hashSerialized);
+    BOOST_CHECK_EQUAL(statsLoaded.nTransactionOutputs, expected.nTransactionOutputs);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_corrupt)
+{
+    SnapshotMetadata metadata;
+    CCoinsStats stats;
+    const fs::path path = WriteSnapshot("utxo_corrupt.dat", metadata, stats);
+
+    // A snapshot claiming one coin more than it holds is rejected
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        SnapshotMetadata metadataRead;
+        file >> metadataRead;
+        metadataRead.m_coins_count++;
+        CCoinsStats statsRead;
+        BOOST_CHECK(!ReadUTXOSnapshot(file, metadataRead, statsRead));
+    }
+
+    // So is one with trailing data
+    {
+        FILE* f = fsbridge::fopen(path, "ab");
+        fputc(0, f);
+        fclose(f);
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        SnapshotMetadata metadataRead;
+        file >> metadataRead;
+        CCoinsStats statsRead;
+        BOOST_CHECK(!ReadUTXOSnapshot(file, metadataRead, statsRead));
+    }
+
+    // And anything that is not a snapshot
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        file << std::string("not a snapshot");
+    }
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    SnapshotMetadata metadataRead;
+    BOOST_CHECK_THROW(file >> metadataRead, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,11 +5,13 @@
 #include <boost/test/unit_test.hpp>
 
 #include <chainparams.h>
+#include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/validation.h>
 #include <miner.h>
 #include <pow.h>
 #include <random.h>
+#include <streams.h>
 #include <test/test_bitcoin.h>
 #include <validation.h>
 #include <validationinterface.h>
@@ -184,4 +186,178 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
     BOOST_CHECK_EQUAL(sub.m_expected_tip, chainActive.Tip()->GetBlockHash());
 }
 
+// construct a header on top of prev whose proof of work is valid or not
+static CBlockHeader PoWHeader(const CBlockHeader& prev, bool valid_pow)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = prev.GetHash();
+    header.nTime = prev.nTime + 1;
+    header.nBits = prev.nBits;
+    while (CheckProofOfWork(header.GetPoWHash(GetPoWProfile(header, consensus)), header.nBits, consensus) != valid_pow) {
+        ++header.nNonce;
+    }
+    return header;
+}
+
+BOOST_AUTO_TEST_CASE(processnewblockheaders_batch_pow)
+{
+    CValidationState state;
+    std::vector<CBlockHeader> headers;
+    CBlockHeader prev = Params().GenesisBlock().GetBlockHeader();
+    for (int i = 0; i < 20; i++) {
+        headers.push_back(PoWHeader(prev, true));
+        prev = headers.back();
+    }
+    BOOST_CHECK(ProcessNewBlockHeaders(headers, state, Params()));
+
+    // A batch with a failing header in the middle still accepts its valid
+    // parents and reports the first invalid header.
+    std::vector<CBlockHeader> extension;
+    for (int i = 0; i < 20; i++) {
+        extension.push_back(PoWHeader(prev, i != 13));
+        prev = extension.back();
+    }
+    CBlockHeader first_invalid;
+    BOOST_CHECK(!ProcessNewBlockHeaders(extension, state, Params(), nullptr, &first_invalid));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+    BOOST_CHECK_EQUAL(first_invalid.GetHash(), extension[13].GetHash());
+
+    LOCK(cs_main);
+    for (const CBlockHeader& header : headers) {
+        BOOST_CHECK(mapBlockIndex.count(header.GetHash()));
+    }
+    for (int i = 0; i < 20; i++) {
+        BOOST_CHECK_EQUAL(mapBlockIndex.count(extension[i].GetHash()), i < 13 ? 1U : 0U);
+    }
+}
+
+// construct a valid block whose NeoScrypt proof of work passes CheckBlock()
+static std::shared_ptr<const CBlock> PoWBlock(const uint256& prev_hash, const std::vector<CTransactionRef>& txns = {})
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    auto pblock = Block(prev_hash);
+
+    // The template pays the subsidy of the block after the tip
+    CMutableTransaction txCoinbase(*pblock->vtx[0]);
+    txCoinbase.vout[0].nValue = 0;
+    pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
+    pblock->vtx.insert(pblock->vtx.end(), txns.begin(), txns.end());
+
+    pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+    while (!CheckProofOfWork(pblock->GetPoWHash(GetPoWProfile(*pblock, consensus)), pblock->nBits, consensus)) {
+        ++(pblock->nNonce);
+    }
+    return pblock;
+}
+
+BOOST_AUTO_TEST_CASE(processnewblock_out_of_order)
+{
+    bool ignored;
+    CValidationState state;
+    BOOST_CHECK(ProcessNewBlock(Params(), std::make_shared<CBlock>(Params().GenesisBlock()), true, &ignored));
+
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    std::vector<CBlockHeader> headers;
+    uint256 prev_hash = Params().GenesisBlock().GetHash();
+    for (int i = 0; i < 50; i++) {
+        blocks.push_back(PoWBlock(prev_hash));
+        headers.push_back(blocks.back()->GetBlockHeader());
+        prev_hash = blocks.back()->GetHash();
+    }
+    BOOST_CHECK(ProcessNewBlockHeaders(headers, state, Params()));
+
+    // Every block but the first arrives before its parent and is only stored
+    for (size_t i = blocks.size() - 1; i > 0; i--) {
+        BOOST_CHECK(ProcessNewBlock(Params(), blocks[i], true, &ignored));
+    }
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(chainActive.Height(), 0);
+    }
+
+    // The first block lets the stored ones be read back, checked in the
+    // background and connected
+    BOOST_CHECK(ProcessNewBlock(Params(), blocks[0], true, &ignored));
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(chainActive.Tip()->GetBlockHash(), blocks.back()->GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(connect_block_prefetched_inputs)
+{
+    bool ignored;
+    BOOST_CHECK(ProcessNewBlock(Params(), std::make_shared<CBlock>(Params().GenesisBlock()), true, &ignored));
+
+    // Enough mature coinbase outputs to be fetched by the worker threads
+    const int num_spends = 40;
+    std::vector<CTransactionRef> coinbases;
+    uint256 prev_hash = Params().GenesisBlock().GetHash();
+    for (int i = 0; i < num_spends + COINBASE_MATURITY; i++) {
+        auto pblock = PoWBlock(prev_hash);
+        BOOST_CHECK(ProcessNewBlock(Params(), pblock, true, &ignored));
+        coinbases.push_back(pblock->vtx[0]);
+        prev_hash = pblock->GetHash();
+    }
+
+    // Start from an empty cache so that every input is read from the database
+    FlushStateToDisk();
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(chainActive.Tip()->GetBlockHash(), prev_hash);
+        BOOST_CHECK_EQUAL(pcoinsTip->GetCacheSize(), 0U);
+    }
+
+    std::vector<CTransactionRef> spends;
+    for (int i = 0; i < num_spends; i++) {
+        CMutableTransaction spend;
+        spend.vin.push_back(CTxIn(COutPoint(coinbases[i]->GetHash(), 0)));
+        spend.vout.push_back(CTxOut(0, CScript() << OP_TRUE));
+        spends.push_back(MakeTransactionRef(std::move(spend)));
+    }
+    auto pblock = PoWBlock(prev_hash, spends);
+    BOOST_CHECK(ProcessNewBlock(Params(), pblock, true, &ignored));
+
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(chainActive.Tip()->GetBlockHash(), pblock->GetHash());
+    for (const CTransactionRef& tx : spends) {
+        BOOST_CHECK(!pcoinsTip->HaveCoin(tx->vin[0].prevout));
+        BOOST_CHECK(pcoinsTip->HaveCoin(COutPoint(tx->GetHash(), 0)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(loadexternalblockfile_read_ahead)
+{
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    uint256 prev_hash = Params().GenesisBlock().GetHash();
+    for (int i = 0; i < 30; i++) {
+        blocks.push_back(PoWBlock(prev_hash));
+        prev_hash = blocks.back()->GetHash();
+    }
+
+    // The blocks, with junk between them. One of them is hidden in a record
+    // that does not deserialize, so it is only found by scanning the file
+    // again after the blocks following it were read ahead.
+    const fs::path path = GetDataDir() / "import.dat";
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!file.IsNull());
+        for (size_t i = 0; i < blocks.size(); i++) {
+            const unsigned int size = GetSerializeSize(*blocks[i], CLIENT_VERSION);
+            if (i == 10) {
+                file << Params().MessageStart() << (unsigned int)(100 + 8 + size);
+                for (int j = 0; j < 100; j++) file << (unsigned char)0xff;
+            }
+            file << Params().MessageStart() << size << *blocks[i];
+            file << (unsigned char)i << Params().MessageStart()[0];
+        }
+    }
+
+    BOOST_CHECK(LoadExternalBlockFile(Params(), fsbridge::fopen(path, "rb")));
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(chainActive.Tip()->GetBlockHash(), blocks.back()->GetHash());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,7 @@
 #include <shutdown.h>
 #include <uint256.h>
 #include <util/system.h>
+#include <util/time.h>
 #include <ui_interface.h>
 
 #include <stdint.h>
@@ -53,7 +54,7 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, DBProfile::CHAINSTATE)
 {
 }
 
@@ -81,6 +82,10 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return BatchWrite(mapCoins, hashBlock, true);
+}
+
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fFinal, bool fErase) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -116,7 +121,8 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         }
         count++;
         CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (fErase)
+            mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -132,8 +138,10 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     }
 
     // In the last batch, mark the database as consistent with hashBlock again.
-    batch.Erase(DB_HEAD_BLOCKS);
-    batch.Write(DB_BEST_BLOCK, hashBlock);
+    if (fFinal) {
+        batch.Erase(DB_HEAD_BLOCKS);
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+    }
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
     bool ret = db.WriteBatch(batch);
@@ -146,7 +154,111 @@ size_t CCoinsViewDB::EstimateSize() const
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index", nCacheSize, fMemory, fWipe) {
+CCoinsViewDBFlusher::~CCoinsViewDBFlusher()
+{
+    Sync();
+}
+
+bool CCoinsViewDBFlusher::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        std::lock_guard<std::mutex> lock(cs_pending);
+        if (pending) {
+            CCoinsMap::const_iterator it = pending->find(outpoint);
+            if (it != pending->end()) {
+                if (it->second.coin.IsSpent())
+                    return false;
+                coin = it->second.coin;
+                return true;
+            }
+        }
+    }
+    // Not part of the write in flight, so the database entry is current.
+    return db->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewDBFlusher::HaveCoin(const COutPoint &outpoint) const {
+    {
+        std::lock_guard<std::mutex> lock(cs_pending);
+        if (pending) {
+            CCoinsMap::const_iterator it = pending->find(outpoint);
+            if (it != pending->end())
+                return !it->second.coin.IsSpent();
+        }
+    }
+    return db->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewDBFlusher::GetBestBlock() const {
+    {
+        std::lock_guard<std::mutex> lock(cs_pending);
+        if (pending)
+            return hashPending;
+    }
+    return db->GetBestBlock();
+}
+
+std::vector<uint256> CCoinsViewDBFlusher::GetHeadBlocks() const {
+    return db->GetHeadBlocks();
+}
+
+bool CCoinsViewDBFlusher::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (!Sync())
+        return false;
+    CCoinsMap* pmap;
+    {
+        std::lock_guard<std::mutex> lock(cs_pending);
+        pending.reset(new CCoinsMap(std::move(mapCoins)));
+        mapCoins.clear();
+        hashPending = hashBlock;
+        pmap = pending.get();
+    }
+    writer = std::thread(&CCoinsViewDBFlusher::ThreadWrite, this, pmap, hashBlock);
+    return true;
+}
+
+void CCoinsViewDBFlusher::ThreadWrite(CCoinsMap* pmap, uint256 hashBlock) {
+    RenameThread("bitcoin-coinsflush");
+    int64_t nStart = GetTimeMicros();
+    bool ret;
+    try {
+        // Only this thread reads the map without holding cs_pending, and nobody modifies it.
+        ret = db->BatchWrite(*pmap, hashBlock, true, false);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("Error writing to coin database: %s\n", e.what());
+        ret = false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(cs_pending);
+        if (ret) {
+            pending.reset();
+        } else {
+            // Keep serving reads from the flushed entries; the database is behind them.
+            fFailed = true;
+        }
+    }
+    condWritten.notify_all();
+    LogPrint(BCLog::COINDB, "Background flush to %s %s in %.2fms\n", hashBlock.ToString(), ret ? "completed" : "failed", (GetTimeMicros() - nStart) * 0.001);
+}
+
+CCoinsViewCursor *CCoinsViewDBFlusher::Cursor() const {
+    {
+        std::unique_lock<std::mutex> lock(cs_pending);
+        condWritten.wait(lock, [this] { return !pending || fFailed; });
+    }
+    return db->Cursor();
+}
+
+size_t CCoinsViewDBFlusher::EstimateSize() const {
+    return db->EstimateSize();
+}
+
+bool CCoinsViewDBFlusher::Sync() {
+    if (writer.joinable())
+        writer.join();
+    return !fFailed;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index", nCacheSize, fMemory, fWipe, false, DBProfile::BLOCK_TREE) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -419,6 +531,21 @@ bool CBlockTreeDB::WriteSyncCheckpoint(uint256 hashCheckpoint)
     return Write(std::string("hashSyncCheckpoint"), hashCheckpoint);
 }
 
+bool CBlockTreeDB::ReadSnapshotBase(uint256& hashBase, unsigned int& nChainTx)
+{
+    std::pair<uint256, unsigned int> base;
+    if (!Read(std::string("snapshotBase"), base))
+        return false;
+    hashBase = base.first;
+    nChainTx = base.second;
+    return true;
+}
+
+bool CBlockTreeDB::WriteSnapshotBase(const uint256& hashBase, unsigned int nChainTx)
+{
+    return Write(std::string("snapshotBase"), std::make_pair(hashBase, nChainTx), true);
+}
+
 bool CBlockTreeDB::ReadCheckpointPubKey(std::string& strPubKey)
 {
     return Read(std::string("strCheckpointPubKey"), strPubKey);
@@ -11,9 +11,13 @@
 #include <chain.h>
 #include <primitives/block.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -39,6 +43,8 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! -backgroundflush default
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
 
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB final : public CCoinsView
@@ -53,6 +59,9 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    //! BatchWrite(), but leave the database marked as in transition to hashBlock unless fFinal,
+    //! and leave mapCoins untouched (so it can be read concurrently) unless fErase
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fFinal, bool fErase = true);
     CCoinsViewCursor *Cursor() const override;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
@@ -60,6 +69,51 @@ public:
     size_t EstimateSize() const override;
 };
 
+/**
+ * CCoinsView in front of a CCoinsViewDB that writes flushed coins to it on a
+ * background thread, so that flushing the coins cache does not hold up block
+ * validation. Until the write has completed, reads are served from the flushed
+ * entries. At most one write is in flight; a crash during it leaves the
+ * database marked with DB_HEAD_BLOCKS and is recovered by ReplayBlocks(), as
+ * with an interrupted synchronous flush.
+ *
+ * BatchWrite() and Sync() must not be called concurrently with each other.
+ */
+class CCoinsViewDBFlusher final : public CCoinsView
+{
+private:
+    CCoinsViewDB* db;
+
+    mutable std::mutex cs_pending;
+    mutable std::condition_variable condWritten;
+    //! Entries being written, and the block they are consistent with
+    std::unique_ptr<CCoinsMap> pending;
+    uint256 hashPending;
+    std::atomic<bool> fFailed{false};
+    std::thread writer;
+
+    void ThreadWrite(CCoinsMap* pmap, uint256 hashBlock);
+
+public:
+    explicit CCoinsViewDBFlusher(CCoinsViewDB* dbIn) : db(dbIn) {}
+    ~CCoinsViewDBFlusher();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    std::vector<uint256> GetHeadBlocks() const override;
+    //! Wait for the previous write, then start writing mapCoins (which is left empty) in the background
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    //! Waits for the write in flight, then iterates over the database
+    CCoinsViewCursor *Cursor() const override;
+    size_t EstimateSize() const override;
+
+    //! Wait for the write in flight to complete. Returns false if any write failed.
+    bool Sync();
+    //! Whether a background write failed, leaving the database behind the flushed state
+    bool HasFailed() const { return fFailed; }
+};
+
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
 class CCoinsViewDBCursor: public CCoinsViewCursor
 {
@@ -100,6 +154,9 @@ public:
     bool WriteSyncCheckpoint(uint256 hashCheckpoint);
     bool ReadCheckpointPubKey(std::string& strPubKey);
     bool WriteCheckpointPubKey(const std::string& strPubKey);
+    //! The base block of the UTXO set snapshot the chainstate was loaded from, and the transaction count up to it
+    bool ReadSnapshotBase(uint256& hashBase, unsigned int& nChainTx);
+    bool WriteSnapshotBase(const uint256& hashBase, unsigned int nChainTx);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -18,10 +18,12 @@
 #include <cuckoocache.h>
 #include <hash.h>
 #include <index/txindex.h>
+#include <node/blockfilemap.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
 #include <pow.h>
+#include <powcache.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <random.h>
@@ -44,6 +46,7 @@
 
 #include <future>
 #include <sstream>
+#include <unordered_set>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -145,6 +148,31 @@ private:
       */
     std::set<CBlockIndex*> m_failed_blocks;
 
+    /**
+     * The base block of the UTXO set snapshot the chainstate was loaded from,
+     * if any. The blocks below it keep the validity of headers we never
+     * downloaded; only the base block's nChainTx is set, from the snapshot.
+     */
+    CBlockIndex* m_snapshot_base = nullptr;
+
+    typedef PoolResource<sizeof(CBlockIndex), alignof(CBlockIndex)> BlockIndexResource;
+    static_assert(std::is_trivially_destructible<CBlockIndex>::value, "block index entries are released without being destroyed");
+    /**
+     * Where the CBlockIndex entries of mapBlockIndex live. They are never
+     * erased one by one, so they are packed back to back into large chunks
+     * instead of being allocated with new: this saves the malloc overhead of
+     * each entry, keeps entries loaded together close in memory, and lets
+     * UnloadBlockIndex() drop them all at once.
+     */
+    std::unique_ptr<BlockIndexResource> m_block_index_resource{new BlockIndexResource(1 << 20)};
+
+    template <typename... Args>
+    CBlockIndex* NewBlockIndex(Args&&... args)
+    {
+        void* p = m_block_index_resource->Allocate(sizeof(CBlockIndex), alignof(CBlockIndex));
+        return ::new (p) CBlockIndex(std::forward<Args>(args)...);
+    }
+
     /**
      * the ChainState CriticalSection
      * A lock that must be held when modifying this ChainState - held in ActivateBestChain()
@@ -165,7 +193,7 @@ public:
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to mapBlockIndex.
      */
-    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Block (dis)connection on a given view:
@@ -182,6 +210,7 @@ public:
     void ResetBlockFailureFlags(CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
+    bool ActivateSnapshotTip(CBlockIndex* pindexBase, unsigned int nChainTx, const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     bool RewindBlockIndex(const CChainParams& params);
     bool LoadGenesisBlock(const CChainParams& chainparams);
 
@@ -235,11 +264,14 @@ int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
+bool fSnapshotChainstate = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fCheckBlockReadPoW = DEFAULT_CHECK_BLOCK_READ_POW;
+bool fMapBlockFiles = DEFAULT_MAP_BLOCK_FILES;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -305,6 +337,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 std::unique_ptr<CCoinsViewDB> pcoinsdbview;
+std::unique_ptr<CCoinsViewDBFlusher> pcoinsflusher;
 std::unique_ptr<CCoinsViewCache> pcoinsTip;
 std::unique_ptr<CBlockTreeDB> pblocktree;
 
@@ -1066,29 +1099,75 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+static BlockFileMap g_block_file_map;
+
+/**
+ * Find the block at pos in a mapping of its block file, after checking the
+ * network magic and size that WriteBlockToDisk stores in front of it. The
+ * mapping has to be kept while block_data is used. Returns false if the block
+ * should be read from the file instead.
+ */
+static bool GetMappedBlock(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start,
+                           std::shared_ptr<const MappedFile>& mapping, Span<const unsigned char>& block_data)
+{
+    if (!fMapBlockFiles || pos.nPos < 8) {
+        return false;
+    }
+    const fs::path path = GetBlockPosFilename(pos, "blk");
+    mapping = g_block_file_map.Get(pos.nFile, path, pos.nPos);
+    if (!mapping) {
+        return false;
+    }
+    const unsigned char* header = mapping->GetSpan().data() + pos.nPos - 8;
+    if (memcmp(header, message_start, CMessageHeader::MESSAGE_START_SIZE)) {
+        return false;
+    }
+    const uint32_t blk_size = ReadLE32(header + CMessageHeader::MESSAGE_START_SIZE);
+    if (blk_size > MAX_SIZE) {
+        return false;
+    }
+    if (pos.nPos + blk_size > mapping->size()) {
+        // The block was appended after the file was mapped.
+        mapping = g_block_file_map.Get(pos.nFile, path, pos.nPos + blk_size);
+        if (!mapping) {
+            return false;
+        }
+    }
+    block_data = mapping->GetSpan().subspan(pos.nPos, blk_size);
+    return true;
+}
+
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    std::shared_ptr<const MappedFile> mapping;
+    Span<const unsigned char> block_data;
+    if (GetMappedBlock(pos, Params().MessageStart(), mapping, block_data)) {
+        try {
+            SpanReader reader(SER_DISK, CLIENT_VERSION, block_data);
+            reader >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
-    unsigned int profile = 0x3;
-    if (block.GetBlockTime() >= consensusParams.nNeoScryptFork)
-        profile = 0x0;
-
     // Check the header
-    if (!CheckProofOfWork(block.GetPoWHash(profile), block.nBits, consensusParams))
+    if (fCheckPOW && !CheckProofOfWorkCached(block, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
     return true;
@@ -1097,12 +1176,16 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
     CDiskBlockPos blockPos;
+    bool fCheckPOW;
     {
         LOCK(cs_main);
         blockPos = pindex->GetBlockPos();
+        // A header at BLOCK_VALID_TREE already passed CheckProofOfWork, and
+        // the GetHash() comparison below ties the block read to that header.
+        fCheckPOW = fCheckBlockReadPoW || !pindex->IsValid(BLOCK_VALID_TREE);
     }
 
-    if (!ReadBlockFromDisk(block, blockPos, consensusParams))
+    if (!ReadBlockFromDisk(block, blockPos, consensusParams, fCheckPOW))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
@@ -1110,8 +1193,85 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
-bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start)
+/**
+ * Copy a serialized block without the witness data of its transactions, by
+ * walking the transaction layout rather than deserializing them.
+ */
+static bool StripBlockWitness(Span<const unsigned char> block, std::vector<uint8_t>& stripped)
+{
+    stripped.clear();
+    stripped.reserve(block.size());
+    SpanReader s(SER_NETWORK, PROTOCOL_VERSION, block);
+    // Append what was read since the last call.
+    size_t copied = 0;
+    auto copy = [&]() {
+        const size_t pos = block.size() - s.size();
+        stripped.insert(stripped.end(), block.begin() + copied, block.begin() + pos);
+        copied = pos;
+    };
+    auto skip = [&]() {
+        copied = block.size() - s.size();
+    };
+
+    try {
+        s.ignore(80); // header
+        const uint64_t tx_count = ReadCompactSize(s);
+        for (uint64_t i = 0; i < tx_count; ++i) {
+            s.ignore(4); // nVersion
+            copy();
+            uint64_t vin_count = ReadCompactSize(s);
+            bool has_witness = false;
+            if (vin_count == 0) {
+                // The extended format: a zero marker, then the flags.
+                unsigned char flags;
+                s >> flags;
+                if (flags != 1) return false;
+                skip();
+                has_witness = true;
+                vin_count = ReadCompactSize(s);
+            }
+            for (uint64_t j = 0; j < vin_count; ++j) {
+                s.ignore(36); // prevout
+                s.ignore(ReadCompactSize(s)); // scriptSig
+                s.ignore(4); // nSequence
+            }
+            const uint64_t vout_count = ReadCompactSize(s);
+            for (uint64_t j = 0; j < vout_count; ++j) {
+                s.ignore(8); // nValue
+                s.ignore(ReadCompactSize(s)); // scriptPubKey
+            }
+            copy();
+            if (has_witness) {
+                for (uint64_t j = 0; j < vin_count; ++j) {
+                    const uint64_t stack_size = ReadCompactSize(s);
+                    for (uint64_t k = 0; k < stack_size; ++k) {
+                        s.ignore(ReadCompactSize(s));
+                    }
+                }
+                skip();
+            }
+            s.ignore(4); // nLockTime
+        }
+        copy();
+    } catch (const std::exception&) {
+        return false;
+    }
+    return s.empty();
+}
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start, bool with_witness)
 {
+    std::shared_ptr<const MappedFile> mapping;
+    Span<const unsigned char> block_data;
+    if (GetMappedBlock(pos, message_start, mapping, block_data)) {
+        if (with_witness) {
+            block.assign(block_data.begin(), block_data.end());
+        } else if (!StripBlockWitness(block_data, block)) {
+            return error("%s: Malformed block data at %s", __func__, pos.ToString());
+        }
+        return true;
+    }
+
     CDiskBlockPos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
     CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
@@ -1142,10 +1302,18 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos,
         return error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
     }
 
+    if (!with_witness) {
+        std::vector<uint8_t> stripped;
+        if (!StripBlockWitness(Span<const unsigned char>(block.data(), block.size()), stripped)) {
+            return error("%s: Malformed block data at %s", __func__, pos.ToString());
+        }
+        block.swap(stripped);
+    }
+
     return true;
 }
 
-bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start, bool with_witness)
 {
     CDiskBlockPos block_pos;
     {
@@ -1153,7 +1321,16 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
         block_pos = pindex->GetBlockPos();
     }
 
-    return ReadRawBlockFromDisk(block, block_pos, message_start);
+    if (!ReadRawBlockFromDisk(block, block_pos, message_start, with_witness)) {
+        return false;
+    }
+    // The header is the first 80 bytes either way; hashing it is far cheaper
+    // than the proof of work check ReadBlockFromDisk may do.
+    if (block.size() < 80 || Hash(block.begin(), block.begin() + 80) != pindex->GetBlockHash()) {
+        return error("%s: block hash doesn't match index for %s at %s", __func__,
+                pindex->ToString(), block_pos.ToString());
+    }
+    return true;
 }
 
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
@@ -1498,7 +1675,9 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
-static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+} // namespace
+
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
 {
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
@@ -1529,6 +1708,8 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 static bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1698,6 +1879,261 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Closure representing the proof-of-work check of a run of block headers
+ * sharing the same NeoScrypt profile. The headers are hashed together so the
+ * multi-lane NeoScrypt engines can be used.
+ */
+class CPoWCheck
+{
+private:
+    std::vector<CBlockHeader> headers;
+    const Consensus::Params* params;
+
+public:
+    CPoWCheck() : params(nullptr) {}
+    CPoWCheck(std::vector<CBlockHeader>&& headersIn, const Consensus::Params& paramsIn) : headers(std::move(headersIn)), params(&paramsIn) {}
+
+    bool operator()() {
+        std::vector<uint256> hashes(headers.size());
+        CBlockHeader::GetPoWHashes(headers.data(), headers.size(), GetPoWProfile(headers[0], *params), hashes.data());
+        for (size_t i = 0; i < headers.size(); i++) {
+            if (!CheckProofOfWork(hashes[i], headers[i].nBits, *params))
+                return false;
+            AddPoWCacheEntry(headers[i].GetHash());
+        }
+        return true;
+    }
+
+    void swap(CPoWCheck& check) {
+        headers.swap(check.headers);
+        std::swap(params, check.params);
+    }
+};
+
+static CCheckQueue<CPoWCheck> powcheckqueue(16);
+
+void ThreadPoWCheck() {
+    RenameThread("bitcoin-powch");
+    powcheckqueue.Thread();
+}
+
+/** Number of headers hashed together by a single CPoWCheck */
+static const size_t POW_CHECK_BATCH_SIZE = 8;
+
+/**
+ * Verify the proof of work of all headers not yet in mapBlockIndex or the
+ * PoW cache on the PoW check worker threads, without holding cs_main.
+ * fPoWChecked is set for every header not in mapBlockIndex. Returns false if
+ * any header fails, in which case the caller falls back to the serial checks
+ * to find and report it.
+ */
+static bool CheckBlockHeadersPoW(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams, std::vector<bool>& fPoWChecked) LOCKS_EXCLUDED(cs_main)
+{
+    std::vector<bool> fNew(headers.size());
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < headers.size(); i++)
+            fNew[i] = !mapBlockIndex.count(headers[i].GetHash());
+    }
+
+    std::vector<CPoWCheck> vChecks;
+    std::vector<CBlockHeader> batch;
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (!fNew[i] || IsPoWCached(headers[i].GetHash()))
+            continue;
+        if (!batch.empty() && (batch.size() == POW_CHECK_BATCH_SIZE || GetPoWProfile(batch[0], consensusParams) != GetPoWProfile(headers[i], consensusParams))) {
+            vChecks.emplace_back(std::move(batch), consensusParams);
+            batch.clear();
+        }
+        batch.push_back(headers[i]);
+    }
+    if (!batch.empty())
+        vChecks.emplace_back(std::move(batch), consensusParams);
+
+    CCheckQueueControl<CPoWCheck> control(&powcheckqueue);
+    control.Add(vChecks);
+    if (!control.Wait())
+        return false;
+
+    fPoWChecked = std::move(fNew);
+    return true;
+}
+
+/**
+ * Context-free checks of the blocks ActivateBestChainStep() is about to
+ * connect. During initial block download most blocks arrive out of order
+ * and are only connected later, from disk; reading them back and running
+ * CheckBlock() (proof of work, merkle root, CheckTransaction) on the worker
+ * threads overlaps that work with ConnectBlock() of their predecessors.
+ *
+ * The same workers deserialize and check the blocks LoadExternalBlockFile()
+ * reads during -reindex and -loadblock.
+ */
+class CBlockCheckPipeline
+{
+private:
+    struct Job {
+        uint256 hash;
+        CDiskBlockPos pos;
+        bool fCheckPOW;
+        //! Serialized block to import, instead of reading it from pos
+        std::vector<unsigned char> data;
+        const Consensus::Params* params;
+        std::promise<std::shared_ptr<const CBlock>> promise;
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<Job> queue;
+    int nWorkers = 0;
+
+    //! Blocks being or already checked, by hash
+    std::map<uint256, std::future<std::shared_ptr<const CBlock>>> mapPending GUARDED_BY(cs_main);
+
+    static std::shared_ptr<const CBlock> Check(const Job& job)
+    {
+        if (!job.data.empty())
+            return CheckImported(job);
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        CValidationState state;
+        if (!ReadBlockFromDisk(*pblock, job.pos, *job.params, job.fCheckPOW) || pblock->GetHash() != job.hash)
+            return nullptr;
+        // Failures are reported again, and acted upon, by ConnectTip()
+        if (!CheckBlock(*pblock, state, *job.params))
+            return nullptr;
+        return pblock;
+    }
+
+    static std::shared_ptr<const CBlock> CheckImported(const Job& job)
+    {
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        try {
+            SpanReader reader(SER_DISK, CLIENT_VERSION, MakeSpan(job.data));
+            reader >> *pblock;
+        } catch (const std::exception& e) {
+            LogPrintf("LoadExternalBlockFile: Deserialize error - %s\n", e.what());
+            return nullptr;
+        }
+        // Blocks failing the checks are still returned: AcceptBlock() checks
+        // them again and marks them invalid. Passing ones are not checked again.
+        CValidationState state;
+        CheckBlock(*pblock, state, *job.params);
+        return pblock;
+    }
+
+public:
+    void Thread()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nWorkers++;
+        }
+        try {
+            while (true) {
+                Job job;
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    while (queue.empty())
+                        cond.wait(lock);
+                    job = std::move(queue.front());
+                    queue.pop_front();
+                }
+                job.promise.set_value(Check(job));
+            }
+        } catch (const boost::thread_interrupted&) {
+            // The last worker to leave fails the remaining jobs, so that
+            // nobody waits for them forever.
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (--nWorkers == 0) {
+                for (Job& job : queue)
+                    job.promise.set_value(nullptr);
+                queue.clear();
+            }
+            throw;
+        }
+    }
+
+    /** Queue the checks of the blocks to connect, given in reverse order as built by ActivateBestChainStep(). */
+    void Prefetch(const std::vector<CBlockIndex*>& vpindexToConnect, const Consensus::Params& params) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        // Forget blocks that are no longer about to be connected
+        std::set<uint256> setWanted;
+        for (const CBlockIndex* pindex : vpindexToConnect)
+            setWanted.insert(pindex->GetBlockHash());
+        for (auto it = mapPending.begin(); it != mapPending.end();) {
+            if (setWanted.count(it->first))
+                ++it;
+            else
+                it = mapPending.erase(it);
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nWorkers == 0)
+            return;
+        for (const CBlockIndex* pindex : reverse_iterate(vpindexToConnect)) {
+            if (mapPending.count(pindex->GetBlockHash()) || !(pindex->nStatus & BLOCK_HAVE_DATA))
+                continue;
+            Job job;
+            job.hash = pindex->GetBlockHash();
+            job.pos = pindex->GetBlockPos();
+            job.fCheckPOW = fCheckBlockReadPoW || !pindex->IsValid(BLOCK_VALID_TREE);
+            job.params = &params;
+            mapPending.emplace(job.hash, job.promise.get_future());
+            queue.push_back(std::move(job));
+        }
+        cond.notify_all();
+    }
+
+    /**
+     * Deserialize and check a block read by LoadExternalBlockFile() on the
+     * worker threads, or right away if there are none. The result is nullptr
+     * if the data does not deserialize.
+     */
+    std::future<std::shared_ptr<const CBlock>> Import(std::vector<unsigned char>&& data, const Consensus::Params& params)
+    {
+        Job job;
+        job.fCheckPOW = true;
+        job.data = std::move(data);
+        job.params = &params;
+        std::future<std::shared_ptr<const CBlock>> result = job.promise.get_future();
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nWorkers == 0) {
+            lock.unlock();
+            job.promise.set_value(Check(job));
+            return result;
+        }
+        queue.push_back(std::move(job));
+        cond.notify_one();
+        return result;
+    }
+
+    /** The checked block with this hash, waiting for its check if needed, or nullptr if it was not queued or failed. */
+    std::shared_ptr<const CBlock> Take(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        auto it = mapPending.find(hash);
+        if (it == mapPending.end())
+            return nullptr;
+        std::shared_ptr<const CBlock> pblock = it->second.get();
+        mapPending.erase(it);
+        return pblock;
+    }
+
+    void Clear() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        mapPending.clear();
+    }
+};
+
+static CBlockCheckPipeline blockcheckpipeline;
+
+void ThreadBlockCheck() {
+    RenameThread("bitcoin-blockch");
+    blockcheckpipeline.Thread();
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -2035,6 +2471,8 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
     std::set<int> setFilesToPrune;
     bool full_flush_completed = false;
     try {
+    if (pcoinsflusher && pcoinsflusher->HasFailed())
+        return AbortNode(state, "Failed to write to coin database");
     {
         bool fFlushForPrune = false;
         bool fDoFullFlush = false;
@@ -2100,9 +2538,13 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                     return AbortNode(state, "Failed to write to block index database");
                 }
             }
-            // Finally remove any pruned files
-            if (fFlushForPrune)
+            // Finally remove any pruned files, once an earlier coins flush
+            // which may still need them for a replay is on disk.
+            if (fFlushForPrune) {
+                if (pcoinsflusher && !pcoinsflusher->Sync())
+                    return AbortNode(state, "Failed to write to coin database");
                 UnlinkPrunedFiles(setFilesToPrune);
+            }
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -2117,6 +2559,10 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // Flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            // With -backgroundflush the coins are still being written. Only
+            // callers asking for everything to be on disk wait for that.
+            if (mode == FlushStateMode::ALWAYS && pcoinsflusher && !pcoinsflusher->Sync())
+                return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
             full_flush_completed = true;
         }
@@ -2271,7 +2717,97 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
     return true;
 }
 
+/**
+ * Closure reading a run of coins from the view behind the coins cache
+ * (ultimately the coin database). Coins that are not found are left spent.
+ */
+class CCoinsFetch
+{
+private:
+    const CCoinsView* view;
+    const COutPoint* outpoints;
+    Coin* coins;
+    size_t count;
+
+public:
+    CCoinsFetch() : view(nullptr), outpoints(nullptr), coins(nullptr), count(0) {}
+    CCoinsFetch(const CCoinsView& viewIn, const COutPoint* outpointsIn, Coin* coinsIn, size_t countIn) :
+        view(&viewIn), outpoints(outpointsIn), coins(coinsIn), count(countIn) {}
+
+    bool operator()() {
+        for (size_t i = 0; i < count; i++) {
+            view->GetCoin(outpoints[i], coins[i]);
+        }
+        return true;
+    }
+
+    void swap(CCoinsFetch& check) {
+        std::swap(view, check.view);
+        std::swap(outpoints, check.outpoints);
+        std::swap(coins, check.coins);
+        std::swap(count, check.count);
+    }
+};
+
+static CCheckQueue<CCoinsFetch> coinsfetchqueue(16);
+
+void ThreadCoinsFetch() {
+    RenameThread("bitcoin-coinsfetch");
+    coinsfetchqueue.Thread();
+}
+
+/** Number of outpoints read by a single CCoinsFetch */
+static const size_t COINS_FETCH_BATCH_SIZE = 16;
+
+/**
+ * Read the coins a block spends that are not in the coins cache yet on the
+ * coins fetch threads, and add them to the cache, so that ConnectBlock() does
+ * not wait for the coin database one input at a time. Outputs created within
+ * the block are skipped; they are not in the database.
+ *
+ * The cache must stay untouched while the reads are in flight: an outpoint
+ * missing from it means the database entry is current, but only until the
+ * cache is modified. That rules out prefetching ahead of the block being
+ * connected.
+ */
+static void PrefetchBlockInputs(const CBlock& block, CCoinsViewCache& view) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (!nScriptCheckThreads)
+        return;
+
+    std::unordered_set<uint256, SaltedTxidHasher> setTxids;
+    for (const auto& tx : block.vtx) {
+        setTxids.insert(tx->GetHash());
+    }
+    std::vector<COutPoint> vOutpoints;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (!setTxids.count(txin.prevout.hash) && !view.HaveCoinInCache(txin.prevout))
+                vOutpoints.push_back(txin.prevout);
+        }
+    }
+    // Not worth waking up the workers for a single batch.
+    if (vOutpoints.size() <= COINS_FETCH_BATCH_SIZE)
+        return;
+
+    std::vector<Coin> vCoins(vOutpoints.size());
+    std::vector<CCoinsFetch> vFetches;
+    for (size_t i = 0; i < vOutpoints.size(); i += COINS_FETCH_BATCH_SIZE) {
+        vFetches.emplace_back(*view.GetBackend(), &vOutpoints[i], &vCoins[i], std::min(COINS_FETCH_BATCH_SIZE, vOutpoints.size() - i));
+    }
+    CCheckQueueControl<CCoinsFetch> control(&coinsfetchqueue);
+    control.Add(vFetches);
+    control.Wait();
+
+    for (size_t i = 0; i < vOutpoints.size(); i++) {
+        view.CacheCoin(vOutpoints[i], std::move(vCoins[i]));
+    }
+}
+
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2350,20 +2886,26 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     assert(pindexNew->pprev == chainActive.Tip());
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
-    std::shared_ptr<const CBlock> pthisBlock;
-    if (!pblock) {
+    std::shared_ptr<const CBlock> pthisBlock = pblock;
+    if (!pthisBlock) {
+        // Already read and checked by the block check pipeline, if queued
+        pthisBlock = blockcheckpipeline.Take(pindexNew->GetBlockHash());
+    }
+    if (!pthisBlock) {
         std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
         if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
             return AbortNode(state, "Failed to read block");
         pthisBlock = pblockNew;
-    } else {
-        pthisBlock = pblock;
     }
     const CBlock& blockConnecting = *pthisBlock;
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    PrefetchBlockInputs(blockConnecting, *pcoinsTip);
+    int64_t nTime2b = GetTimeMicros(); nTimePrefetch += nTime2b - nTime2;
+    LogPrint(BCLog::BENCH, "  - Prefetch inputs: %.2fms [%.2fs]\n", (nTime2b - nTime2) * MILLI, nTimePrefetch * MICRO);
+    nTime2 = nTime2b;
     {
         CCoinsViewCache view(pcoinsTip.get());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -2511,6 +3053,11 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
         }
         nHeight = nTargetHeight;
 
+        // Only one block is connected before returning to release the lock,
+        // so check the following ones in the background meanwhile.
+        if (vpindexToConnect.size() > 1)
+            blockcheckpipeline.Prefetch(vpindexToConnect, chainparams.GetConsensus());
+
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
@@ -2867,7 +3414,7 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = NewBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3029,12 +3576,8 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
 
 static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
 {
-    unsigned int profile = 0x3;
-    if (block.GetBlockTime() >= consensusParams.nNeoScryptFork)
-        profile = 0x0;
-
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetPoWHash(profile), block.nBits, consensusParams))
+    if (fCheckPOW && !CheckProofOfWorkCached(block, consensusParams))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     return true;
@@ -3325,7 +3868,7 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     return true;
 }
 
-bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3343,7 +3886,7 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3410,11 +3953,19 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+
+    // Check the proof of work of the whole batch in parallel before taking
+    // cs_main, so that only the contextual checks run under the lock.
+    std::vector<bool> fPoWChecked(headers.size(), false);
+    if (nScriptCheckThreads && headers.size() > 1)
+        CheckBlockHeadersPoW(headers, chainparams.GetConsensus(), fPoWChecked);
+
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex, !fPoWChecked[i])) {
                 if (first_invalid) *first_invalid = header;
                 return false;
             }
@@ -3648,6 +4199,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        g_block_file_map.Drop(*it);
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3818,7 +4370,7 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = NewBlockIndex();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -3830,23 +4382,36 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
     if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
         return false;
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
+    uint256 hashSnapshotBase;
+    unsigned int nSnapshotChainTx = 0;
+    blocktree.ReadSnapshotBase(hashSnapshotBase, nSnapshotChainTx);
+
+    // Calculate nChainWork. Heights are dense, so order the entries by height
+    // with a counting sort rather than a comparison sort of all of them.
+    std::vector<size_t> vHeightStart;
     for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
     {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
-    }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
+        const size_t nHeight = item.second->nHeight;
+        if (nHeight + 2 > vHeightStart.size())
+            vHeightStart.resize(nHeight + 2, 0);
+        vHeightStart[nHeight + 1]++;
+    }
+    for (size_t i = 1; i < vHeightStart.size(); i++)
+        vHeightStart[i] += vHeightStart[i - 1];
+    std::vector<CBlockIndex*> vSortedByHeight(mapBlockIndex.size());
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        vSortedByHeight[vHeightStart[item.second->nHeight]++] = item.second;
+    for (CBlockIndex* pindex : vSortedByHeight)
     {
-        CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions at some point.
-        // Pruned nodes may have deleted the block.
-        if (pindex->nTx > 0) {
+        // Pruned nodes may have deleted the block. A UTXO set snapshot stands in for the
+        // transactions up to its base block.
+        if (pindex->GetBlockHash() == hashSnapshotBase) {
+            pindex->nChainTx = nSnapshotChainTx;
+            m_snapshot_base = pindex;
+        } else if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->HaveTxsDownloaded()) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3862,7 +4427,7 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
             pindex->nStatus |= BLOCK_FAILED_CHILD;
             setDirtyBlockIndex.insert(pindex);
         }
-        if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->HaveTxsDownloaded() || pindex->pprev == nullptr))
+        if ((pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->HaveTxsDownloaded() || pindex->pprev == nullptr)) || pindex == m_snapshot_base)
             setBlockIndexCandidates.insert(pindex);
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
@@ -3872,6 +4437,16 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
             pindexBestHeader = pindex;
     }
 
+    // Blocks received below the snapshot base block do not wait for their parents
+    if (m_snapshot_base) {
+        for (auto it = mapBlocksUnlinked.begin(); it != mapBlocksUnlinked.end();) {
+            if (m_snapshot_base->GetAncestor(it->second->nHeight) == it->second)
+                it = mapBlocksUnlinked.erase(it);
+            else
+                ++it;
+        }
+    }
+
     return true;
 }
 
@@ -3925,6 +4500,11 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_RE
     pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
     if (fHavePruned)
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+    uint256 hashSnapshotBase;
+    unsigned int nSnapshotChainTx;
+    fSnapshotChainstate = pblocktree->ReadSnapshotBase(hashSnapshotBase, nSnapshotChainTx);
+    if (fSnapshotChainstate)
+        LogPrintf("LoadBlockIndexDB(): The chainstate was loaded from a UTXO set snapshot\n");
 
     // Check whether we need to continue reindexing
     bool fReindexing = false;
@@ -4006,8 +4586,9 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone, false);
         if (pindex->nHeight <= chainActive.Height()-nCheckDepth)
             break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, only go back as far as we have data.
+        if ((fPruneMode || fHavePruned) && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, or the chainstate was loaded from a UTXO set
+            // snapshot, only go back as far as we have data.
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
@@ -4204,6 +4785,80 @@ void CChainState::EraseBlockData(CBlockIndex* index)
     }
 }
 
+bool CChainState::ActivateSnapshotTip(CBlockIndex* pindexBase, unsigned int nChainTx, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+    if (chainActive.Height() != 0)
+        return error("%s: the chain is past the genesis block", __func__);
+    if (!pindexBase->IsValid(BLOCK_VALID_TREE) || nChainTx == 0)
+        return error("%s: invalid snapshot base block %s", __func__, pindexBase->GetBlockHash().ToString());
+
+    // The blocks below the base block are left as headers: their data is
+    // missing like that of pruned blocks, and nothing records them as
+    // validated or counts their transactions. The snapshot's transaction
+    // count is kept apart, in the block tree database, and only set as the
+    // base block's nChainTx so that the blocks on top of it link up.
+    for (CBlockIndex* pindex = pindexBase; pindex->pprev; pindex = pindex->pprev) {
+        // Do not make RewindBlockIndex() rewind these to download them with witnesses
+        if (IsWitnessEnabled(pindex->pprev, chainparams.GetConsensus()) && !(pindex->nStatus & BLOCK_OPT_WITNESS)) {
+            pindex->nStatus |= BLOCK_OPT_WITNESS;
+            setDirtyBlockIndex.insert(pindex);
+        }
+        auto range = mapBlocksUnlinked.equal_range(pindex->pprev);
+        for (auto it = range.first; it != range.second;) {
+            if (it->second == pindex)
+                it = mapBlocksUnlinked.erase(it);
+            else
+                ++it;
+        }
+    }
+    if (!pblocktree->WriteSnapshotBase(pindexBase->GetBlockHash(), nChainTx))
+        return error("%s: failed to write the snapshot base block", __func__);
+    m_snapshot_base = pindexBase;
+    pindexBase->nChainTx = nChainTx;
+    chainActive.SetTip(pindexBase);
+    setBlockIndexCandidates.insert(pindexBase);
+
+    // Link any blocks already received on top of the base block, as
+    // ReceivedBlockTransactions() does
+    std::deque<CBlockIndex*> queue;
+    auto range = mapBlocksUnlinked.equal_range(pindexBase);
+    while (range.first != range.second) {
+        queue.push_back(range.first->second);
+        range.first = mapBlocksUnlinked.erase(range.first);
+    }
+    while (!queue.empty()) {
+        CBlockIndex *pindex = queue.front();
+        queue.pop_front();
+        pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+        {
+            LOCK(cs_nBlockSequenceId);
+            pindex->nSequenceId = nBlockSequenceId++;
+        }
+        if (!setBlockIndexCandidates.value_comp()(pindex, chainActive.Tip())) {
+            setBlockIndexCandidates.insert(pindex);
+        }
+        range = mapBlocksUnlinked.equal_range(pindex);
+        while (range.first != range.second) {
+            queue.push_back(range.first->second);
+            range.first = mapBlocksUnlinked.erase(range.first);
+        }
+    }
+    PruneBlockIndexCandidates();
+
+    fHavePruned = true;
+    pblocktree->WriteFlag("prunedblockfiles", true);
+    fSnapshotChainstate = true;
+    LogPrintf("%s: new best=%s height=%d tx=%lu (loaded from a UTXO set snapshot)\n", __func__,
+        pindexBase->GetBlockHash().ToString(), pindexBase->nHeight, (unsigned long)pindexBase->nChainTx);
+    return true;
+}
+
+bool ActivateSnapshotTip(CBlockIndex* pindexBase, unsigned int nChainTx, const CChainParams& chainparams)
+{
+    return g_chainstate.ActivateSnapshotTip(pindexBase, nChainTx, chainparams);
+}
+
 bool CChainState::RewindBlockIndex(const CChainParams& params)
 {
     // Note that during -reindex-chainstate we are called with an empty chainActive!
@@ -4319,7 +4974,12 @@ bool RewindBlockIndex(const CChainParams& params) {
 void CChainState::UnloadBlockIndex() {
     nBlockSequenceId = 1;
     m_failed_blocks.clear();
+    m_snapshot_base = nullptr;
     setBlockIndexCandidates.clear();
+    // Start over with a new map and new entries rather than clear(), which
+    // would keep the memory of both.
+    mapBlockIndex = BlockMap();
+    m_block_index_resource.reset(new BlockIndexResource(1 << 20));
 }
 
 // May NOT be used after any connections are up as much
@@ -4335,18 +4995,17 @@ void UnloadBlockIndex()
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
+    g_block_file_map.Clear();
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
     versionbitscache.Clear();
+    blockcheckpipeline.Clear();
     for (int b = 0; b < VERSIONBITS_NUM_BITS; b++) {
         warningcache[b].clear();
     }
 
-    for (const BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
-    mapBlockIndex.clear();
     fHavePruned = false;
+    fSnapshotChainstate = false;
 
     g_chainstate.UnloadBlockIndex();
 }
@@ -4403,51 +5062,104 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
+/** Blocks LoadExternalBlockFile() reads ahead of the one it is accepting */
+static const size_t MAX_IMPORT_BLOCKS_AHEAD = 128;
+/** Serialized size of the blocks LoadExternalBlockFile() reads ahead */
+static const size_t MAX_IMPORT_BYTES_AHEAD = 64 << 20;
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
+    // Blocks are read from the file on this thread, deserialized and checked
+    // (proof of work, merkle root, CheckTransaction) on the block check worker
+    // threads, and accepted here again, in the order of the file.
+    struct PendingBlock {
+        uint64_t nRewind; //!< where to scan again if it turns out not to be a block
+        uint64_t nBlockPos;
+        size_t nSize;
+        std::future<std::shared_ptr<const CBlock>> block;
+    };
+    std::deque<PendingBlock> pending;
+    size_t nPendingBytes = 0;
+
     int nLoaded = 0;
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        bool fScanned = false;
+        while (true) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> buf;
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+            if (!fScanned && pending.size() < MAX_IMPORT_BLOCKS_AHEAD && nPendingBytes < MAX_IMPORT_BYTES_AHEAD) {
+                if (blkdat.eof()) {
+                    fScanned = true;
+                    continue;
+                }
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                    blkdat.FindByte(chainparams.MessageStart()[0]);
+                    nRewind = blkdat.GetPos()+1;
+                    blkdat >> buf;
+                    if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    fScanned = true;
                     continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                }
+                PendingBlock next;
+                next.nRewind = nRewind;
+                next.nBlockPos = blkdat.GetPos();
+                next.nSize = nSize;
+                try {
+                    // read block
+                    std::vector<unsigned char> data(nSize);
+                    blkdat.read((char*)data.data(), nSize);
+                    nRewind = blkdat.GetPos();
+                    next.block = blockcheckpipeline.Import(std::move(data), chainparams.GetConsensus());
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
                     continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
+                }
+                nPendingBytes += nSize;
+                pending.push_back(std::move(next));
+                continue;
+            }
+
+            if (pending.empty())
                 break;
+            PendingBlock next = std::move(pending.front());
+            pending.pop_front();
+            nPendingBytes -= next.nSize;
+            std::shared_ptr<const CBlock> pblock = next.block.get();
+            if (!pblock) {
+                // Scan again from just past its header, for blocks within the
+                // data. The blocks read after it are read again.
+                pending.clear();
+                nPendingBytes = 0;
+                fScanned = false;
+                nRewind = next.nRewind;
+                if (!blkdat.SetPos(nRewind))
+                    blkdat.Seek(nRewind);
+                continue;
             }
+            const CBlock& block = *pblock;
+
             try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
+                    dbp->nPos = next.nBlockPos;
 
                 uint256 hash = block.GetHash();
                 {
@@ -4568,13 +5280,16 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
     CBlockIndex* pindexFirstNotScriptsValid = nullptr; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
     while (pindex != nullptr) {
         nNodes++;
+        // The UTXO set snapshot vouches for its base block and the blocks below
+        // it, so what they lack does not carry over to their descendants.
+        const bool fAssumed = m_snapshot_base && pindex->pprev && m_snapshot_base->GetAncestor(pindex->nHeight) == pindex;
         if (pindexFirstInvalid == nullptr && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
-        if (pindexFirstMissing == nullptr && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
-        if (pindexFirstNeverProcessed == nullptr && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
+        if (!fAssumed && pindexFirstMissing == nullptr && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (!fAssumed && pindexFirstNeverProcessed == nullptr && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != nullptr && pindexFirstNotTreeValid == nullptr && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
-        if (pindex->pprev != nullptr && pindexFirstNotTransactionsValid == nullptr && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TRANSACTIONS) pindexFirstNotTransactionsValid = pindex;
-        if (pindex->pprev != nullptr && pindexFirstNotChainValid == nullptr && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
-        if (pindex->pprev != nullptr && pindexFirstNotScriptsValid == nullptr && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
+        if (!fAssumed && pindex->pprev != nullptr && pindexFirstNotTransactionsValid == nullptr && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TRANSACTIONS) pindexFirstNotTransactionsValid = pindex;
+        if (!fAssumed && pindex->pprev != nullptr && pindexFirstNotChainValid == nullptr && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
+        if (!fAssumed && pindex->pprev != nullptr && pindexFirstNotScriptsValid == nullptr && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
 
         // Begin: actual consistency checks.
         if (pindex->pprev == nullptr) {
@@ -4596,8 +5311,11 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
         if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
         assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0)); // This is pruning-independent.
         // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to HaveTxsDownloaded().
-        assert((pindexFirstNeverProcessed == nullptr) == pindex->HaveTxsDownloaded());
-        assert((pindexFirstNotTransactionsValid == nullptr) == pindex->HaveTxsDownloaded());
+        // Below a snapshot base block only the base block itself is linked.
+        if (!fAssumed || pindex == m_snapshot_base) {
+            assert((pindexFirstNeverProcessed == nullptr) == pindex->HaveTxsDownloaded());
+            assert((pindexFirstNotTransactionsValid == nullptr) == pindex->HaveTxsDownloaded());
+        }
         assert(pindex->nHeight == nHeight); // nHeight must be consistent.
         assert(pindex->pprev == nullptr || pindex->nChainWork >= pindex->pprev->nChainWork); // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight))); // The pskip pointer must point back for all but the first 2 blocks.
@@ -4889,16 +5607,3 @@ double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pin
 
     return pindex->nChainTx / fTxTotal;
 }
-
-class CMainCleanup
-{
-public:
-    CMainCleanup() {}
-    ~CMainCleanup() {
-        // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
-        mapBlockIndex.clear();
-    }
-} instance_of_cmaincleanup;
@@ -17,6 +17,7 @@
 #include <policy/feerate.h>
 #include <protocol.h> // For CMessageHeader::MessageStartChars
 #include <script/script_error.h>
+#include <support/allocators/pool.h>
 #include <sync.h>
 #include <versionbits.h>
 
@@ -27,6 +28,7 @@
 #include <set>
 #include <stdint.h>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -34,8 +36,10 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CChainParams;
 class CCoinsViewDB;
+class CCoinsViewDBFlusher;
 class CInv;
 class CConnman;
 class CScriptCheck;
@@ -117,6 +121,8 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 /** Default for -permitbaremultisig */
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
+/** Re-verify the proof of work of blocks read from disk even if their header is already validated */
+static const bool DEFAULT_CHECK_BLOCK_READ_POW = false;
 static const bool DEFAULT_TXINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
@@ -150,7 +156,14 @@ extern CCriticalSection cs_main;
 extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
 extern std::atomic_bool g_is_mempool_loaded;
-typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+/**
+ * The nodes of the map come from a PoolResource, like those of CCoinsMap; the
+ * CBlockIndex entries they point to are allocated from a separate one owned by
+ * the chainstate. Both are released as a whole by UnloadBlockIndex().
+ */
+typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher, std::equal_to<uint256>,
+                           PoolAllocator<std::pair<const uint256, CBlockIndex*>,
+                                         sizeof(std::pair<const uint256, CBlockIndex*>) + sizeof(void*) * 4>> BlockMap;
 extern BlockMap& mapBlockIndex GUARDED_BY(cs_main);
 extern const std::string strMessageMagic;
 extern Mutex g_best_block_mutex;
@@ -163,6 +176,9 @@ extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+extern bool fCheckBlockReadPoW;
+/** Whether blocks are read through memory mappings of the block files, see BlockFileMap. */
+extern bool fMapBlockFiles;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
@@ -187,6 +203,8 @@ static const uint64_t nMinDiskSpace = 52428800;
 /** Pruning-related variables and constants */
 /** True if any block files have ever been pruned. */
 extern bool fHavePruned;
+/** True if the chainstate was loaded from a UTXO set snapshot, missing the blocks below it like pruned ones. */
+extern bool fSnapshotChainstate;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
 /** Number of MiB of block files that we're trying to stay below. */
@@ -263,8 +281,21 @@ bool LoadBlockIndex(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs
 bool LoadChainTip(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 /** Unload database information */
 void UnloadBlockIndex();
+/**
+ * Make the base block of a UTXO set snapshot, whose coins were just written
+ * to the coins database, the tip of a chain that is still at the genesis
+ * block. Its ancestors are treated like pruned blocks; nChainTx is the
+ * trusted transaction count pinned in chainparams.
+ */
+bool ActivateSnapshotTip(CBlockIndex* pindexBase, unsigned int nChainTx, const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header proof-of-work checking thread */
+void ThreadPoWCheck();
+/** Run an instance of the block pre-validation thread */
+void ThreadBlockCheck();
+/** Run an instance of the block input prefetching thread */
+void ThreadCoinsFetch();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -392,10 +423,19 @@ void InitScriptExecutionCache();
 
 
 /** Functions for disk access for blocks */
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW = true);
+/** Read a block known to the index. The proof of work is only recomputed for
+ *  blocks whose header was never validated (or with -checkblockreadpow);
+ *  otherwise matching the index hash is enough. */
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
-bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start);
-bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/** Read a block as serialized on disk, which is its network serialization,
+ *  without deserializing it. With with_witness false the witness data of its
+ *  transactions is left out, as for peers that do not support segwit. The
+ *  CBlockIndex variant checks the header against the index hash. */
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start, bool with_witness = true);
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start, bool with_witness = true);
+
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -460,6 +500,9 @@ extern CChain& chainActive;
 /** Global variable that points to the coins database (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewDB> pcoinsdbview;
 
+/** Global variable that points to the background writer in front of pcoinsdbview, if -backgroundflush (protected by cs_main) */
+extern std::unique_ptr<CCoinsViewDBFlusher> pcoinsflusher;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewCache> pcoinsTip;
 
@@ -3418,7 +3418,7 @@ UniValue generate(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "No coinbase script available");
     }
 
-    return generateBlocks(coinbase_script, num_generate, max_tries, true);
+    return generateBlocks(coinbase_script, num_generate, max_tries, true, gArgs.GetArg("-genproclimit", DEFAULT_GENERATE_THREADS));
 }
 
 UniValue rescanblockchain(const JSONRPCRequest& request)